@@ -1,510 +1,4338 @@
-/***************************************************************************************/
-/*                                                                                     */
-/* Cipher Program in C, written by Timothy Powell                                      */
-/*  A command line program                                                             */
-/*                                                                                     */
-/*     Created: January 27, 2025                                                       */
-/* Last Edited: January 29, 2025                                                       */
-/*                                                                                     */
-/* This is adapted from a program with the same function written in C++. It asks the   */
-/* user whether to encrypt or decrypt, lets him choose an encryption method, and       */
-/* outputs both the cipertext and the plaintext.                                       */
-/*                                                                                     */
-/***************************************************************************************/
-
-/***************************************************************************************/
-/*                                      LIBRARIES                                      */
-/***************************************************************************************/
-#include <ctype.h>  /* isalpha(), tolower()                                            */
-#include <stdio.h>  /* fgets(), printf(), scanf(), stdin                               */
-#include <stdlib.h> /* exit(), free(), malloc()                                        */
-
-/***************************************************************************************/
-/*                                      CONSTANTS                                      */
-/***************************************************************************************/
-#define CAESAR    'c' /* Used to select the caesar cipher                              */
-#define VIGENERE  'v' /* Used to select the vigenere cipher                            */
-#define ENCODE    'e' /* Used to select the encoding action                            */
-#define DECODE    'd' /* Used to select the decoding action                            */
-#define UPPER     'u' /* Used to determine if a character is upper case                */
-#define LOWER     'l' /* Used to determine if a character is lower case                */
-#define NEITHER   'n' /* Used to determine if a character is not a letter              */
-#define LOWER_INT 97  /* Used to make a lowercase letter usable in calculations        */
-#define UPPER_INT 65  /* Used to make an uppercase letter usable in calculations       */
-
-/***************************************************************************************/
-/*                                       STRUCTS                                       */
-/***************************************************************************************/
-/* Struct to hold the string in a linked list                                          */
-struct letter {
-   char          character;       /* Holds the character in the link                   */
-   struct letter *next_character; /* Points to the next letter in the list             */
-};
-typedef struct letter LETTER;
-
-/***************************************************************************************/
-/*                                FUNCTION DECLARATIONS                                */
-/***************************************************************************************/
-/* Gives the user instructions                                                         */
-void   give_instructions();
-
-/* Determines if the user wants to continue                                            */
-char   user_response();
-
-/* Determines which cipher the user wants to use                                       */
-char   get_cipher();
-
-/* Determines if the user wants to encode or decode                                    */
-char   get_action();
-
-/* Creates a string                                                                    */
-LETTER *create_string();
-
-/* Get the rotation for the caesar cipher                                              */
-void   get_rotation(int *rotation);
-
-/* Get the key for the vigenere cipher                                                 */
-void   get_key(LETTER *key);
-
-/* Gets a string from the user                                                         */
-void   get_string(LETTER *text);
-
-/* Encodes a message using the caesar cipher                                           */
-void   encode_caesar_cipher(LETTER *plaintext, int rotation);
-
-/* Decodes a message using the caesar cipher                                           */
-void   decode_caesar_cipher(LETTER *ciphertext, int rotation);
-
-/* Encodes a message using a vigenere cipher                                           */
-void   encode_vigenere_cipher(LETTER *plaintext, LETTER *key);
-
-/* Decodes a message using a vigenere cipher                                           */
-void   decode_vigenere_cipher(LETTER *ciphertext, LETTER *key);
-
-/* Prints a string                                                                     */
-void   print_string(LETTER *text);
-
-/* Deletes a string                                                                    */
-void   clear_string(LETTER *text);
-
-/* Tells the user goodbye                                                              */
-void   farewell();
-
-/* Tests if a character is uppercase or lowercase                                      */
-char   test_character(char check);
-
-/* Sets a string to lowercase                                                          */
-void   to_lower(LETTER *string);
-
-/***************************************************************************************/
-/*                                    MAIN FUNCTION                                    */
-/***************************************************************************************/
-int    main() {
-   LETTER *message, /* Points to the message to be encrypted or decrypted              */
-          *key;     /* Points to the key used in encrypting or decrypting              */
-   char   cipher,   /* Holds the user's choice of cipher                               */
-          action;   /* Holds the user's choice of encryption or decryption             */
-   int    rotation; /* Holds the rotation used in encrypting or decrypting             */
-
-   /* Greet the user                                                                   */
-   give_instructions();
-
-   /* Loop until the user says to stop                                                 */
-   while(user_response() == 'y') {
-
-      /* Get the cipher, action to take, message to apply, and key/rotation            */
-      cipher  = get_cipher();
-      action  = get_action();
-      message = create_string();
-      get_string(message);
-      if (cipher == CAESAR) {
-         get_rotation(&rotation);
-      } else if (cipher == VIGENERE) {
-         key = create_string();
-         get_key(key);
-         to_lower(key);
-      }
-
-      /* Print the inputted message in its original form                               */
-      if (action == ENCODE) {
-         printf("\nPlaintext:  ");
-      } else if (action == DECODE) {
-         printf("\nCiphertext: ");
-      }
-      print_string(message);
-
-      /* Apply the action with the caesar cipher                                       */
-      if (cipher == CAESAR) {
-         if (action == ENCODE) {
-            encode_caesar_cipher(message, rotation);
-         } else if (action == DECODE) {
-            decode_caesar_cipher(message, rotation);
-         } else {
-            printf("\nError with Caesar Cipher.");
-         }
-      
-      /* Apply the action with the vigenere cipher                                     */
-      } else if (cipher == VIGENERE) {
-         if (action == ENCODE) {
-            encode_vigenere_cipher(message, key);
-         } else if (action == DECODE) {
-            decode_vigenere_cipher(message, key);
-         } else {
-            printf("\nError with Vigenere Cipher");
-         }
-      } else {
-         printf("\nError with Ciphers.");
-      }
-
-      /* Print the inputted message in its changed form                                */
-      if (action == 'e') {
-         printf("\nCiphertext: ");
-      } else {
-         printf("\nPlaintext:  ");
-      }
-      print_string(message);
-
-      /* Print the key/rotation                                                        */
-      if (cipher == CAESAR) {
-         printf("\nRotation:   %d", rotation);
-      } else if (cipher == VIGENERE) {
-         printf("\nKey:        ");
-         print_string(key);
-         clear_string(key);
-      }
-
-      /* Clear the string                                                              */
-      clear_string(message);
-   }
-
-   /* Give the user a farewell                                                         */
-   farewell();
-   
-   return 0;
-}
-
-/***************************************************************************************/
-/*                                 FUNCTION DEFINITIONS                                */
-/***************************************************************************************/
-/* Gives the user instructions                                                         */
-void   give_instructions() {
-   printf("\n");
-   printf("\n");
-   printf("\nWelcome");
-   printf("\n");
-   printf("\nThis program takes in a message and either encodes into or decodes from");
-   printf("\na cipher of your choice.");
-
-   return;
-}
-
-/* Determines if the user wants to encode or decode                                    */
-char   user_response() {
-   char answer[2]; /* Holds the user's response                                        */
-
-   printf("\n");
-   printf("\nWould you like to continue (y/n)?");
-   printf("\n");
-   do {
-      printf(" >> ");
-      scanf("%1s", answer);
-      answer[0] = tolower(answer[0]);
-   } while (answer[0] != 'y' && answer[0] != 'n');
-
-   return answer[0];
-}
-
-/* Determines which cipher the user wants to use                                       */
-char   get_cipher() {
-   char cipher[2]; /* Holds the user's response                                        */
-
-   printf("\n");
-   printf("\nWhich cipher would you like to use?");
-   printf("\n c) Caesar Cipher");
-   printf("\n v) Vigenere Cipher");
-   printf("\n");
-   do {
-      printf(" >> ");
-      scanf("%1s", cipher);
-      cipher[0] = tolower(cipher[0]);
-   } while (cipher[0] != 'c' && cipher[0] != 'v');
-
-   return cipher[0];
-}
-
-/* Determines if the user wants to encode or decode                                    */
-char   get_action() {
-   char action[2]; /* Holds the user's response                                        */
-
-   printf("\n");
-   printf("\nWhat would you like to do?");
-   printf("\n e) Encode");
-   printf("\n d) Decode");
-   printf("\n");
-   do {
-      printf(" >> ");
-      scanf("%1s", action);
-      action[0] = tolower(action[0]);
-   } while (action[0] != 'e' && action[0] != 'd');
-
-   return action[0];
-}
-
-/* Creates a string                                                                    */
-LETTER *create_string() {
-   LETTER *new_string; /* Points to the new string                                     */
-   
-   /* Create the header of the string                                                  */
-   if ((new_string = (LETTER *) malloc(sizeof(LETTER))) == NULL) {
-      printf("\nFailed to allocate the header of the string.");
-      printf("\nExiting the program.");
-      exit(0);
-   }
-   new_string->character = '~';
-
-   /* Create the trailer of the string                                                 */
-   if ((new_string->next_character = (LETTER *) malloc(sizeof(LETTER))) == NULL) {
-      printf("\nFailed to allocate the trailer of the string.");
-      printf("\nExiting the program.");
-      exit(0);
-   }
-   new_string->next_character->character      = '\0';
-   new_string->next_character->next_character = NULL;
-
-   return new_string;
-}
-
-/* Get the rotation for the caesar cipher                                              */
-void   get_rotation(int *rotation) {
-   printf("\nEnter a rotation: ");
-   printf("\n");
-   scanf("%d", rotation);
-
-   return;
-}
-
-/* Get the key for the vigenere cipher                                                 */
-void   get_key(LETTER *key) {
-   LETTER *held_letter,          /* Points to the letter following the new letter      */
-          *current_letter = key; /* Points to the letter receiving the new letter      */
-   char   new_character;         /* Holds the character to be added to the string      */
-
-   printf("\nEnter the key: ");
-   printf("\n");
-   printf(" >> ");
-   scanf(" ");
-   while (fgets(&new_character, 2, stdin), new_character != '\n') {
-      held_letter = current_letter->next_character;
-      if ((current_letter->next_character = (LETTER *) malloc(sizeof(LETTER))) == NULL) {
-         printf("\nFailed to allocate a letter of the key.");
-         printf("\nExiting the program.");
-         exit(0);
-      }
-      current_letter                 = current_letter->next_character;
-      current_letter->next_character = held_letter;
-      current_letter->character      = new_character;
-   }
-
-   return;
-}
-
-/* Gets a string from the user                                                         */
-void   get_string(LETTER *text) {
-   LETTER *held_letter,           /* Points to the letter following the new letter     */
-          *current_letter = text; /* Points to the letter receiving the new letter     */
-   char   new_character;          /* Holds the character to be added to the string     */
-
-   printf("\nEnter the message: ");
-   printf("\n >> ");
-   scanf(" ");
-   while (fgets(&new_character, 2, stdin), new_character != '\n') {
-      held_letter = current_letter->next_character;
-      if ((current_letter->next_character = (LETTER *) malloc(sizeof(LETTER))) == NULL) {
-         printf("\nFailed to allocate a letter of the string.");
-         printf("\nExiting the program.");
-         exit(0);
-      }
-      current_letter                 = current_letter->next_character;
-      current_letter->next_character = held_letter;
-      current_letter->character      = new_character;
-   }
-   
-   return;
-}
-
-/* Encodes a message using the caesar cipher                                           */
-void   encode_caesar_cipher(LETTER *plaintext, int rotation) {
-   LETTER *current_letter = plaintext->next_character;
-                                                 /* Points to the letter being decoded */
-
-   while (current_letter->character != '\0') {
-      if (test_character(current_letter->character) == UPPER) {
-         current_letter->character =
-                     (current_letter->character - UPPER_INT + rotation) % 26 + UPPER_INT;
-      } else if (test_character(current_letter->character) == LOWER) {
-         current_letter->character =
-                     (current_letter->character - LOWER_INT + rotation) % 26 + LOWER_INT;
-      }
-      current_letter = current_letter->next_character;
-   }
-
-   return;
-}
-
-/* Decodes a message using the caesar cipher                                           */
-void   decode_caesar_cipher(LETTER *ciphertext, int rotation) {
-   LETTER *current_letter = ciphertext->next_character;
-                                                 /* Points to the letter being decoded */
-
-   while (current_letter->character != '\0') {
-      if (test_character(current_letter->character) == UPPER) {
-         current_letter->character =
-                (current_letter->character - UPPER_INT - rotation + 26) % 26 + UPPER_INT;
-      } else if (test_character(current_letter->character) == LOWER) {
-         current_letter->character =
-                (current_letter->character - LOWER_INT - rotation + 26) % 26 + LOWER_INT;
-      }
-      current_letter = current_letter->next_character;
-   }
-
-   return;
-}
-
-/* Encodes a message using a vigenere cipher                                           */
-void   encode_vigenere_cipher(LETTER *plaintext, LETTER *key) {
-   LETTER *current_letter = plaintext->next_character,
-                                                 /* Points to the letter being encoded */
-          *key_cycler     = key->next_character; /* Points to the encoding letter      */
-
-   /* Loop while there are non-encoded letters in the message                          */
-   while (current_letter->character != '\0') {
-      
-      /* Cycle to a workable letters in the key                                        */
-      while (!isalpha(key_cycler->character)) {
-         if (key_cycler->character == '\0') {
-            key_cycler = key->next_character;
-         } else {
-            key_cycler = key_cycler->next_character;
-         }
-      }
-
-      /* Encode the letter                                                             */
-      if (test_character(current_letter->character) == UPPER) {
-         current_letter->character = (current_letter->character - UPPER_INT + (key_cycler->character - LOWER_INT) + 26) % 26 + UPPER_INT;
-         key_cycler = key_cycler->next_character;
-      } else if (test_character(current_letter->character) == LOWER) {
-         current_letter->character =  (current_letter->character - LOWER_INT + (key_cycler->character - LOWER_INT) + 26) % 26 + LOWER_INT;
-         key_cycler = key_cycler->next_character;
-      }
-
-      /* Cycle to a workable letter in the message                                     */
-      current_letter = current_letter->next_character;
-      while (!isalpha(current_letter->character) && current_letter->character != '\0') {
-         current_letter = current_letter->next_character;
-      }
-   }
-
-   return;
-}
-
-/* Decodes a message using a vigenere cipher                                           */
-void   decode_vigenere_cipher(LETTER *ciphertext, LETTER *key) {
-   LETTER *current_letter = ciphertext->next_character,
-                                                 /* Points to the letter being decoded */
-          *key_cycler     = key->next_character; /* Points to the decoding letter      */
-
-   /* Loop while there are non-decoded letters in the message                          */
-   while (current_letter->character != '\0') {
-
-      /* Cycle to a workable letter in the key                                         */
-      while (!isalpha(key_cycler->character)) {
-         if (key_cycler->character == '\0') {
-            key_cycler = key->next_character;
-         } else {
-            key_cycler = key_cycler->next_character;
-         }
-      }
-
-      /* Decode the letter                                                             */
-      if (test_character(current_letter->character) == UPPER) {
-         current_letter->character = (current_letter->character - UPPER_INT -
-                              (key_cycler->character - LOWER_INT) + 26) % 26 + UPPER_INT;
-         key_cycler = key_cycler->next_character;
-      } else if (test_character(current_letter->character) == LOWER) {
-         current_letter->character = (current_letter->character - LOWER_INT -
-                              (key_cycler->character - LOWER_INT) + 26) % 26 + LOWER_INT;
-         key_cycler = key_cycler->next_character;
-      }
-
-      /* Cycle to a workable letter in the message                                     */
-      current_letter = current_letter->next_character;
-      while (!isalpha(current_letter->character) && current_letter->character != '\0') {
-         current_letter = current_letter->next_character;
-      }
-   }
-
-   return;
-}
-
-/* Prints a string                                                                     */
-void   print_string(LETTER *text) {
-   LETTER *current_letter = text->next_character;
-                                                 /* Points to the letter being printed */
-
-   while (current_letter->character != '\0') {
-      printf("%c", current_letter->character);
-      current_letter = current_letter->next_character;
-   }
-
-   return;
-}
-
-/* Deletes a string                                                                    */
-void   clear_string(LETTER *text) {
-   LETTER *current_letter = text, /* Points to the letter being cleared                */
-          *next_letter    = current_letter->next_character;
-                                   /* Points to the next letter to be cleared          */
-
-   while (current_letter != NULL) {
-      next_letter  = next_letter->next_character;
-      free(current_letter);
-      current_letter = next_letter;
-   }
-
-   return;
-}
-
-/* Tells the user goodbye                                                              */
-void   farewell() {
-   printf("\nThank you for using the program!");
-
-   return;
-}
-
-/* Tests if a character is uppercase or lowercase                                      */
-char   test_character(char check) {
-   char test; /* Holds the test's response                                             */
-
-   if (check >= 'a' && check <= 'z') {
-      test = LOWER;
-   } else if (check >= 'A' && check <= 'Z') {
-      test = UPPER;
-   } else {
-      test = NEITHER;
-   }
-
-   return test;
-}
-
-/* Sets a string to lowercase                                                          */
-void   to_lower(LETTER *string) {
-   LETTER *current_letter = string->next_character;
-                                  /* Points to the letter being converted to lowercase */
-
-   while (current_letter->character != '\0') {
-      current_letter->character = tolower(current_letter->character);
-      current_letter            = current_letter->next_character;
-   }
-
-   return;
-}
\ No newline at end of file
+/***************************************************************************************/
+/*                                                                                     */
+/* Cipher Program in C, written by Timothy Powell                                      */
+/*  A command line program                                                             */
+/*                                                                                     */
+/*     Created: January 27, 2025                                                       */
+/* Last Edited: October 16, 2026                                                       */
+/*                                                                                     */
+/* This is adapted from a program with the same function written in C++. It asks the   */
+/* user whether to encrypt or decrypt, lets him choose an encryption method, and       */
+/* outputs both the cipertext and the plaintext.                                       */
+/*                                                                                     */
+/***************************************************************************************/
+
+/***************************************************************************************/
+/*                                      LIBRARIES                                      */
+/***************************************************************************************/
+#include <ctype.h>        /* tolower()                                                 */
+#include <dirent.h>       /* closedir(), opendir(), readdir()                          */
+#include <errno.h>        /* errno                                                     */
+#include <fcntl.h>        /* open(), fcntl()                                           */
+#include <limits.h>       /* INT_MAX, INT_MIN, ULLONG_MAX                              */
+#include <pthread.h>      /* pthread_create(), pthread_join(), pthread_mutex_lock()    */
+#include <signal.h>       /* sigaction(), signal(), sig_atomic_t                       */
+#include <stdint.h>       /* SIZE_MAX                                                  */
+#include <stdio.h>        /* fread(), fwrite(), getchar(), printf(), scanf()           */
+#include <stdlib.h>       /* exit(), free(), malloc(), realloc(), strtol(), strtoull() */
+#include <string.h>       /* strcmp(), strerror(), strlen()                            */
+#include <sys/mman.h>     /* madvise(), mmap(), munmap()                               */
+#include <sys/resource.h> /* getrusage()                                               */
+#include <sys/socket.h>   /* accept(), bind(), connect(), listen(), recv(), send()     */
+#include <sys/stat.h>     /* fstat(), stat()                                           */
+#include <sys/uio.h>      /* writev()                                                  */
+#include <sys/un.h>       /* struct sockaddr_un                                        */
+#include <time.h>         /* clock_gettime()                                           */
+#include <unistd.h>       /* close(), ftruncate(), write()                             */
+#include "Cipher.h"       /* cipher_create_caesar(), cipher_encrypt(), ...             */
+
+/* The cycle counter is read whenever the compiler can target x86                      */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_CYCLES
+#include <x86intrin.h> /* __rdtsc()                                                    */
+#endif
+
+/* The pipeline moves its chunks through io_uring wherever the system headers know of  */
+/* it and of reading at the current position, and through threads everywhere else      */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h> /* struct io_uring_params, struct io_uring_sqe, IORING_*() */
+#include <sys/syscall.h>    /* __NR_io_uring_setup, __NR_io_uring_enter                */
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define LINUX_URING
+#endif
+#endif
+#endif
+
+/* The server waits on epoll, so it is only built where there is epoll to wait on      */
+#ifdef __linux__
+#define LINUX_EPOLL
+#include <sys/epoll.h>   /* epoll_create1(), epoll_ctl(), epoll_wait()                 */
+#include <sys/eventfd.h> /* eventfd()                                                  */
+#endif
+
+/***************************************************************************************/
+/*                                      CONSTANTS                                      */
+/***************************************************************************************/
+#define CAESAR     'c'      /* Used to select the caesar cipher                        */
+#define VIGENERE   'v'      /* Used to select the vigenere cipher                      */
+#define ENCODE     'e'      /* Used to select the encoding action                      */
+#define DECODE     'd'      /* Used to select the decoding action                      */
+#define CRACK      'k'      /* Used to select finding the key of a ciphertext          */
+#define TRAIN      'q'      /* Used to select building a quadgram table from a corpus  */
+#define CHECK      'x'      /* Used to select checking the ciphers against slow ones   */
+#define NEITHER    'n'      /* Used to mark a choice not yet made                      */
+#define LOWER_INT  97       /* Used to make a lowercase letter usable in calculations  */
+#define UPPER_INT  65       /* Used to make an uppercase letter usable in calculations */
+#define START_SIZE 64       /* Number of characters a new string has room for          */
+#define CHUNK_SIZE 65536    /* Number of characters streamed through at a time         */
+#define ALPHABET   26       /* Number of letters in the alphabet                       */
+#define SHARE_SIZE 1048576  /* Number of characters streamed to each thread at a time  */
+#define MAP_WINDOW 16777216 /* Number of characters of a file mapped at a time         */
+#define VECTOR_CAP 1024     /* Most buffers handed to one writev() call                */
+#define BENCH_MIN  64       /* Number of characters in the smallest benchmark message  */
+#define BENCH_STEP 64       /* Number of times larger each benchmark message gets      */
+#define BENCH_TIME 0.25     /* Fewest seconds each benchmark run is timed for          */
+#define BENCH_SEED 88172645 /* Starting state of the benchmark's random numbers        */
+#define BENCH_KEYS 1024     /* Number of keys the records of a batch benchmark share   */
+#define READING    0        /* Stage of reading input                                  */
+#define ALLOCATING 1        /* Stage of allocating and enlarging strings               */
+#define CIPHERING  2        /* Stage of running the cipher                             */
+#define WRITING    3        /* Stage of writing output                                 */
+#define SEARCHING  4        /* Stage of searching for a rotation or key                */
+#define CLEANING   5        /* Stage of freeing everything at the end                  */
+#define STAGES     6        /* Number of stages the program is timed in                */
+#define SAMPLE_CAP 262144   /* Number of letters a vigenere crack reads by default     */
+#define PIPE_CHUNK 262144   /* Number of characters in each buffer of the pipeline     */
+#define PIPE_DEPTH 4        /* Number of buffers in the pipeline's ring                */
+#define READ_TAG   1        /* Marks the completion of a read in the pipeline          */
+#define WRITE_TAG  2        /* Marks the completion of a write in the pipeline         */
+#define IO_AUTO    'a'      /* Used to select io_uring, or threads where it is missing */
+#define IO_URING   'u'      /* Used to select moving chunks through io_uring           */
+#define IO_THREADS 't'      /* Used to select moving chunks with a reader and writer   */
+#define IO_SERIAL  's'      /* Used to select reading, changing and writing in turn    */
+#define KEY_CAP    64       /* Longest key a vigenere crack tries by default           */
+#define TREE_SPLIT 1048576  /* Largest file of a directory changed whole in one task   */
+#define TREE_CHUNK 8388608  /* Number of characters in each task of a split file       */
+#define WALK_TASK  'w'      /* Marks a task that lists a directory                     */
+#define FILE_TASK  'f'      /* Marks a task that changes or splits one file            */
+#define COUNT_TASK 'n'      /* Marks a task that counts the letters of a piece         */
+#define PIECE_TASK 'p'      /* Marks a task that changes one piece of a file           */
+#define SERVE      's'      /* Used to select answering requests on a socket           */
+#define LOAD_TEST  'l'      /* Used to select timing a server with many requests       */
+#define SERVE_MAGIC 0x48504943U
+                            /* Starts every request, "CIPH" on a little-endian machine */
+#define SERVE_CAP  16777216 /* Most characters of payload one request may carry        */
+#define SERVE_KEY  4096     /* Most characters of key one request may carry            */
+#define SERVE_SIZE 4096     /* Number of characters a new connection has room for      */
+#define SERVE_WAIT 64       /* Most events taken from epoll at a time                  */
+#define CACHE_CAP  256      /* Number of keys the server keeps ready by default        */
+#define LOAD_KEYS  64       /* Number of keys the load generator picks between         */
+#define LOAD_KEY   8        /* Number of letters in each key of the load generator     */
+#define CHAIN_CAP  64       /* Most ciphers a chain may run in turn                    */
+#define CHAIN_CHECKS 4      /* Number of chains --check folds and runs                 */
+#define CHAIN_SIZE 65536    /* Number of characters each chain is checked on           */
+
+/***************************************************************************************/
+/*                                       STRUCTS                                       */
+/***************************************************************************************/
+/* Struct to hold the string in one contiguous, growable buffer                        */
+struct text {
+   char   *characters; /* Holds the characters of the string, followed by a '\0'       */
+   size_t length,      /* Holds the number of characters in the string                 */
+          capacity;    /* Holds the number of characters the buffer has room for       */
+};
+typedef struct text TEXT;
+
+/* Struct to hold the choices given on the command line                                */
+struct options {
+   char   cipher,       /* Holds the chosen cipher                                     */
+          action;       /* Holds the chosen encryption or decryption                   */
+   int    rotation,     /* Holds the rotation used by the caesar cipher                */
+          threads,      /* Holds the number of threads to split the work between       */
+          in_place;     /* Holds whether the input file is changed itself              */
+   char   *key,         /* Points to the key used by the vigenere cipher, or NULL      */
+          *input_file,  /* Points to the name of the file to read, or NULL for stdin   */
+          *output_file, /* Points to the name of the file to write, or NULL            */
+          *quadgrams,   /* Points to the name of the quadgram table, or NULL           */
+          *chain;       /* Points to the ciphers to run in turn, or NULL               */
+   CIPHER *context;     /* Points to the cipher made from the rotation or key          */
+   int    benchmark,    /* Holds whether the ciphers are benchmarked instead           */
+          json;         /* Holds whether the benchmark prints JSON instead of CSV      */
+   size_t max_size,     /* Holds the size of the largest benchmark message             */
+          sample,       /* Holds the number of letters a vigenere crack reads          */
+          longest;      /* Holds the longest key a vigenere crack tries                */
+   char   io;           /* Holds how a stream moves through the pipeline               */
+   char   *socket_path; /* Points to the socket served or connected to, or NULL        */
+   size_t requests,     /* Holds the number of requests the load generator sends       */
+          payload,      /* Holds the characters in each of those requests              */
+          cache_size;   /* Holds the number of keys the server keeps ready             */
+   int    connections;  /* Holds the number of connections the requests are sent on    */
+};
+typedef struct options OPTIONS;
+
+/* Struct to hold what the program measures about its own run for --stats. Nothing is  */
+/* timed or counted unless it is enabled, so the cost otherwise is one test per stage. */
+struct stats {
+   int                enabled,         /* Holds whether the run is being measured      */
+                      json;            /* Holds whether the report is JSON             */
+   double             started,         /* Holds the clock when the program started     */
+                      seconds[STAGES]; /* Holds the time spent in each stage           */
+   unsigned long long characters,      /* Holds the characters the cipher changed      */
+                      letters,         /* Holds the letters among them                 */
+                      allocations,     /* Holds the strings allocated or enlarged, not */
+                                       /* counting anything the library allocates      */
+                      allocated;       /* Holds the characters those calls asked for   */
+};
+typedef struct stats STATS;
+
+/* Struct to hold a ring of buffers that the chunks of a message go around in turn.    */
+/* Each chunk is read, changed and written, and while one is changed the next can be   */
+/* read and the last written. The counts only grow; a chunk's buffer is its count      */
+/* modulo the depth, and it is free again once the chunk is written.                   */
+struct pipeline {
+   CIPHER_STREAM   *stream;             /* Points to the stream changing the chunks    */
+   char            *buffers;            /* Points to the buffers, one after another    */
+   size_t          chunk,               /* Holds the characters each buffer holds      */
+                   lengths[PIPE_DEPTH], /* Holds the characters read into each buffer  */
+                   filled,              /* Holds the number of chunks read             */
+                   changed,             /* Holds the number of chunks changed          */
+                   written;             /* Holds the number of chunks written          */
+   int             input,               /* Holds the descriptor being read             */
+                   output,              /* Holds the descriptor being written          */
+                   ended,               /* Holds whether the input has ended           */
+                   read_error,          /* Holds the error that stopped reading, or 0  */
+                   write_error;         /* Holds the error that stopped writing, or 0  */
+   pthread_mutex_t lock;                /* Guards the counts between threads           */
+   pthread_cond_t  moved;               /* Signals that a count or error has changed   */
+};
+typedef struct pipeline PIPELINE;
+
+#ifdef LINUX_URING
+/* Struct to hold an io_uring set up by hand: the submission and completion rings the  */
+/* kernel shares with the program, and the entries the submissions are written into    */
+struct uring {
+   int                 file;      /* Holds the descriptor of the ring                  */
+   unsigned            *sq_tail,  /* Points to where the next submission goes          */
+                       *sq_mask,  /* Points to the mask that wraps a submission index  */
+                       *sq_array, /* Points to the order of the submissions            */
+                       *cq_head,  /* Points to the next completion to collect          */
+                       *cq_tail,  /* Points past the last completion                   */
+                       *cq_mask,  /* Points to the mask that wraps a completion index  */
+                       queued;    /* Holds the submissions not handed to the kernel    */
+   struct io_uring_sqe *sqes;     /* Points to the submission entries                  */
+   struct io_uring_cqe *cqes;     /* Points to the completion entries                  */
+   void                *sq_ring,  /* Points to the mapped submission ring              */
+                       *cq_ring;  /* Points to the mapped completion ring              */
+   size_t              sq_size,   /* Holds the size of the submission ring             */
+                       cq_size,   /* Holds the size of the completion ring             */
+                       sqes_size; /* Holds the size of the submission entries          */
+};
+typedef struct uring URING;
+#endif
+
+/* Struct to hold a file of a directory run too large for one task. Its pieces first   */
+/* have their letters counted, so each knows where in the key it starts, and are then  */
+/* changed; the task finishing the last piece closes the files.                        */
+struct job {
+   char   *input,     /* Points to the path of the file read                           */
+          *output;    /* Points to the path of the file written                        */
+   int    input_file, /* Holds the descriptor of the file read                         */
+          output_file,/* Holds the descriptor of the file written, or input_file       */
+          failed;     /* Holds whether a piece could not be counted or changed, which  */
+                      /* the pieces' threads only touch atomically                     */
+   size_t size,       /* Holds the number of characters in the file                    */
+          pieces,     /* Holds the number of pieces the file is split into             */
+          remaining,  /* Holds the pieces not yet through the current step             */
+          *positions; /* Holds the letters before each piece, once counted             */
+};
+typedef struct job JOB;
+
+/* Struct to hold one piece of work of a directory run                                 */
+struct task {
+   char   kind;       /* Holds what the task does                                      */
+   char   *input,     /* Points to the path read, or NULL for a piece                  */
+          *output;    /* Points to the path written, or NULL for a piece               */
+   JOB    *job;       /* Points to the file a piece belongs to, or NULL                */
+   size_t piece;      /* Holds the piece of the file                                   */
+};
+typedef struct task TASK;
+
+/* Struct to hold the tasks of one thread of a directory run. The thread takes its     */
+/* newest task from the bottom, so it keeps working on what it has just split up,      */
+/* while a thread with nothing to do steals the oldest, and largest, from the top.     */
+struct worker {
+   struct pool        *pool;      /* Points to the pool the thread belongs to          */
+   TASK               **tasks;    /* Points to the tasks waiting                       */
+   size_t             top,        /* Holds the place of the oldest task waiting        */
+                      bottom,     /* Holds the place past the newest task waiting      */
+                      capacity;   /* Holds the number of tasks there is room for       */
+   pthread_mutex_t    lock;       /* Guards the tasks against thieves                  */
+   TEXT               *buffer;    /* Points to the buffer small files are read into    */
+   unsigned long long characters, /* Holds the characters the thread changed           */
+                      letters;    /* Holds the letters among them                      */
+   pthread_t          thread;     /* Holds the thread, when it is not the main one     */
+};
+typedef struct worker WORKER;
+
+/* Struct to hold the threads of a directory run and what they share                   */
+struct pool {
+   OPTIONS         *options;   /* Points to the cipher and action to apply             */
+   WORKER          *workers;   /* Points to the threads                                */
+   int             count,      /* Holds the number of threads                          */
+                   in_place,   /* Holds whether the files are changed themselves       */
+                   failed;     /* Holds whether any file could not be changed          */
+   size_t          pending,    /* Holds the tasks not yet finished                     */
+                   queued;     /* Holds the tasks waiting to be taken                  */
+   dev_t           device;     /* Holds the device of the output directory             */
+   ino_t           inode;      /* Holds the inode of the output directory              */
+   pthread_mutex_t lock;       /* Guards the threads going to sleep                    */
+   pthread_cond_t  wake;       /* Signals that a task is waiting or all are finished   */
+};
+typedef struct pool POOL;
+
+/* Struct to hold the header of a request to the server. The key's characters and then */
+/* the payload follow it on the socket, and all of it is in the machine's byte order,  */
+/* since the socket never leaves the machine.                                          */
+struct request {
+   unsigned magic;      /* Holds SERVE_MAGIC                                           */
+   char     cipher,     /* Holds the cipher, CAESAR or VIGENERE                        */
+            action,     /* Holds the action, ENCODE or DECODE                          */
+            unused[2];  /* Pads the header to a whole number of words                  */
+   int      rotation;   /* Holds the rotation of a caesar cipher                       */
+   unsigned key_length, /* Holds the characters of the key that follow                 */
+            length;     /* Holds the characters of the payload that follow             */
+};
+typedef struct request REQUEST;
+
+/* Struct to hold the header of a reply from the server, followed by the payload       */
+struct reply {
+   int      status;     /* Holds 0, or the errno of why the request failed             */
+   unsigned length;     /* Holds the characters of the payload that follow             */
+};
+typedef struct reply REPLY;
+
+/* Struct to hold a cipher the server keeps ready, found by its normalized key in a    */
+/* hash table and kept in order of use so the least recently used one goes first       */
+struct entry {
+   char          cipher;   /* Holds the cipher, CAESAR or VIGENERE                     */
+   int           rotation; /* Holds the rotation of a caesar cipher, from 0 to 25      */
+   char          *key;     /* Points to the lowercase letters of a vigenere key        */
+   size_t        length,   /* Holds the number of letters in the key                   */
+                 users;    /* Holds the number of requests using the cipher            */
+   unsigned long hash;     /* Holds the hash of the cipher, rotation and key           */
+   int           evicted;  /* Holds whether it was dropped while still in use          */
+   CIPHER        *context; /* Points to the cipher                                     */
+   struct entry  *next,    /* Points to the next entry in the same bucket              */
+                 *newer,   /* Points to the entry used just after it                   */
+                 *older;   /* Points to the entry used just before it                  */
+};
+typedef struct entry ENTRY;
+
+/* Struct to hold the ciphers the server keeps ready                                   */
+struct cache {
+   ENTRY              **buckets; /* Points to the first entry of each bucket           */
+   size_t             mask,      /* Holds the number of buckets less one               */
+                      count,     /* Holds the number of entries                        */
+                      capacity;  /* Holds the most entries kept                        */
+   ENTRY              *newest,   /* Points to the entry used most recently             */
+                      *oldest;   /* Points to the entry used least recently            */
+   unsigned long long hits,      /* Holds the requests that found their cipher ready   */
+                      misses;    /* Holds the requests that had to make it             */
+   pthread_mutex_t    lock;      /* Guards the cache between workers                   */
+};
+typedef struct cache CACHE;
+
+/* Struct to hold a client of the server. The requests it sends are read into its      */
+/* buffer one after another, and each is answered in place in the same buffer before   */
+/* the next is looked at, so a client is never answered out of order.                  */
+struct connection {
+   int               file,     /* Holds the socket                                     */
+                     busy,     /* Holds whether a request is being answered            */
+                     closing,  /* Holds whether it hung up while a worker had it       */
+                     finished; /* Holds whether it has shut down its sending side      */
+   char              *data;    /* Points to the characters received                    */
+   size_t            length,   /* Holds the number of characters received              */
+                     capacity, /* Holds the number of characters there is room for     */
+                     used,     /* Holds the characters of the request being answered   */
+                     reply,    /* Holds where the reply starts in the buffer           */
+                     size,     /* Holds the characters of the reply                    */
+                     sent;     /* Holds the characters of the reply already sent       */
+   struct connection *next,    /* Points to the next connection waiting on a worker    */
+                     *after;   /* Points to the next open connection                   */
+};
+typedef struct connection CONNECTION;
+
+/* Struct to hold the server: one thread waits on every socket and hands whole         */
+/* requests to a pool of workers, which hand the answered ones back through an event   */
+/* descriptor to be sent                                                               */
+struct server {
+   OPTIONS            *options;                    /* Points to the options given      */
+   int                listener,                    /* Holds the listening socket       */
+                      events,                      /* Holds the epoll descriptor       */
+                      wakeup,                      /* Holds the event descriptor       */
+                      count,                       /* Holds the number of workers      */
+                      stopping;                    /* Holds whether the workers stop   */
+   CACHE              cache;                       /* Holds the ciphers kept ready     */
+   CONNECTION         *open,                       /* Points to the open connections   */
+                      *waiting,                    /* Points to the oldest unanswered  */
+                      *last,                       /* Points to the newest unanswered  */
+                      *answered;                   /* Points to those ready to send    */
+   unsigned long long served;                      /* Holds the requests answered      */
+   pthread_mutex_t    lock;                        /* Guards the lists of connections  */
+   pthread_cond_t     work;                        /* Signals a request is waiting     */
+   pthread_t          workers[CIPHER_MAX_THREADS]; /* Holds the worker threads         */
+};
+typedef struct server SERVER;
+
+/* Struct to hold one connection of the load generator and the time of each request    */
+struct load {
+   OPTIONS            *options;  /* Points to the options given                        */
+   const char         *keys;     /* Points to the keys the requests pick between       */
+   size_t             count;     /* Holds the number of requests to send               */
+   double             *seconds;  /* Points to the time each request took               */
+   unsigned long long seed;      /* Holds the state of the random numbers              */
+   int                error;     /* Holds the error that stopped it, or 0              */
+   pthread_t          thread;    /* Holds the thread sending the requests              */
+};
+typedef struct load LOAD;
+
+/***************************************************************************************/
+/*                                  GLOBAL VARIABLES                                   */
+/***************************************************************************************/
+/* Holds the measurements of this run, kept global so any function can add to them     */
+static STATS stats;
+
+/* Holds whether a signal has asked the server to stop                                 */
+static volatile sig_atomic_t stop_requested;
+
+/***************************************************************************************/
+/*                                FUNCTION DECLARATIONS                                */
+/***************************************************************************************/
+/* Gives the user instructions                                                         */
+void   give_instructions();
+
+/* Determines if the user wants to continue                                            */
+char   user_response();
+
+/* Determines which cipher the user wants to use                                       */
+char   get_cipher();
+
+/* Determines if the user wants to encode or decode                                    */
+char   get_action();
+
+/* Creates a string                                                                    */
+TEXT   *create_string();
+
+/* Makes room in a string for at least the given number of characters                  */
+void   reserve_string(TEXT *text, size_t capacity);
+
+/* Adds a character to the end of a string                                             */
+void   add_character(TEXT *text, char new_character);
+
+/* Get the rotation for the caesar cipher                                              */
+void   get_rotation(int *rotation);
+
+/* Get the key for the vigenere cipher                                                 */
+void   get_key(TEXT *key);
+
+/* Gets a string from the user                                                         */
+void   get_string(TEXT *text);
+
+/* Prints a string                                                                     */
+void   print_string(TEXT *text);
+
+/* Prints the changed message and its key or rotation with a single write              */
+int    print_result(char action, TEXT *message, CIPHER *context);
+
+/* Writes a whole buffer to a file descriptor, however many calls it takes             */
+int    write_all(int file, const char *characters, size_t length);
+
+/* Writes several buffers to a file descriptor with as few calls as possible           */
+int    write_vector(int file, struct iovec *pieces, int count);
+
+/* Deletes a string                                                                    */
+void   clear_string(TEXT *text);
+
+/* Tells the user goodbye                                                              */
+void   farewell();
+
+/* Runs the program without prompts, streaming stdin to stdout                         */
+int    run_batch(int argc, char *argv[]);
+
+/* Reads the command line into the options                                             */
+int    parse_options(int argc, char *argv[], OPTIONS *options);
+
+/* Tells the user how to use the command line                                          */
+void   give_usage(char *program);
+
+/* Reads a number of characters, allowing a K, M or G after it, or 0 if it is invalid  */
+size_t read_size(char *text);
+
+/* Makes the one cipher that a chain such as caesar:3,vigenere:lemon,rot13 folds to,   */
+/* or gives NULL after saying what was wrong                                           */
+CIPHER *create_chain(const char *spec);
+
+/* Applies the chosen cipher to stdin chunk by chunk and writes the result to stdout   */
+int    stream_message(OPTIONS *options);
+
+/* Changes a message chunk by chunk through a stream, from a file to a descriptor      */
+int    pump_stream(FILE *input, int output, CIPHER_STREAM *stream, TEXT *message);
+
+/* Changes a message through a stream with reading, changing and writing overlapped    */
+int    pipe_stream(int input, int output, CIPHER_STREAM *stream, size_t chunk, char io);
+
+/* Changes the oldest chunk of the pipeline that has been read but not changed         */
+void   change_chunk(PIPELINE *pipeline);
+
+/* Runs the pipeline with a reader thread and a writer thread                          */
+void   run_threads(PIPELINE *pipeline);
+
+/* Reads chunks into free buffers until the input ends                                 */
+void   *read_chunks(void *pipeline);
+
+/* Unlocks the pipeline when its reader is cancelled while waiting for a free buffer   */
+void   unlock_pipeline(void *pipeline);
+
+/* Writes changed chunks in order until every chunk read is written                    */
+void   *write_chunks(void *pipeline);
+
+#ifdef LINUX_URING
+/* Sets up an io_uring, giving 0, or -1 with errno set when the system has none        */
+int    open_uring(URING *ring);
+
+/* Adds a read or write at the current position of a descriptor to the ring            */
+void   queue_transfer(URING *ring, int operation, int file, char *buffer, size_t length,
+                      unsigned long long tag);
+
+/* Hands the queued transfers to the kernel, waiting for one to finish if asked        */
+int    enter_uring(URING *ring, int wait);
+
+/* Runs the pipeline on the calling thread with its transfers on an io_uring           */
+void   run_uring(PIPELINE *pipeline, URING *ring);
+
+/* Takes down an io_uring                                                              */
+void   close_uring(URING *ring);
+#endif
+
+/* Finds the rotation or key of a ciphertext and writes the text decrypted with it     */
+int    crack_message(OPTIONS *options);
+
+/* Finds the rotation of a caesar ciphertext and writes the text decrypted with it     */
+int    crack_caesar(OPTIONS *options, FILE *input, int output, TEXT *message,
+                    const CIPHER_SCORER *scorer);
+
+/* Finds the key of a vigenere ciphertext and writes the text decrypted with it        */
+int    crack_vigenere(OPTIONS *options, FILE *input, int output, TEXT *message,
+                      const CIPHER_SCORER *scorer);
+
+/* Builds a quadgram table from a corpus of English text and saves it                  */
+int    train_quadgrams(OPTIONS *options);
+
+/* Applies the chosen cipher to a file through memory maps                             */
+int    cipher_file(OPTIONS *options);
+
+/* Gives whether a path names a directory                                              */
+int    is_directory(const char *path);
+
+/* Applies the chosen cipher to every file under a directory on a pool of threads      */
+int    cipher_tree(OPTIONS *options);
+
+/* Runs tasks, its own or stolen, until every task of the pool is finished             */
+void   *run_worker(void *worker);
+
+/* Adds a task to the bottom of a thread's tasks and wakes a thread to take it         */
+void   push_task(WORKER *worker, char kind, char *input, char *output, JOB *job,
+                 size_t piece);
+
+/* Takes a thread's newest task, or steals another thread's oldest, or gives NULL      */
+TASK   *take_task(WORKER *worker);
+
+/* Creates the output directory of a directory and adds a task for each entry          */
+void   walk_directory(WORKER *worker, TASK *task);
+
+/* Changes a small file with one read and one write, or splits a large one into pieces */
+void   change_file(WORKER *worker, TASK *task);
+
+/* Counts the letters of a piece, and once every piece is counted, queues the changes  */
+void   count_piece(WORKER *worker, TASK *task);
+
+/* Changes a piece from its place in the key, and closes the file after the last one   */
+void   change_piece(WORKER *worker, TASK *task);
+
+/* Applies the chosen cipher to characters starting at a place in the key              */
+void   apply_action(POOL *pool, size_t position, const char *input, char *output,
+                    size_t length, WORKER *worker);
+
+/* Closes the files of a split file and frees it                                       */
+void   finish_job(POOL *pool, JOB *job);
+
+/* Makes a path from a directory and the name of an entry in it                        */
+char   *join_path(const char *directory, const char *name);
+
+/* Reports a file that could not be changed and marks the run as failed                */
+void   report_failure(POOL *pool, const char *doing, const char *path);
+
+/* Answers requests on a Unix domain socket until it is told to stop                   */
+int    serve_requests(OPTIONS *options);
+
+#ifdef LINUX_EPOLL
+/* Takes every connection waiting on the listening socket                              */
+void   accept_connections(SERVER *server);
+
+/* Reads what a connection has sent and hands it to a worker once a request is whole   */
+void   read_requests(SERVER *server, CONNECTION *connection);
+
+/* Hands a connection to a worker if its next request is whole, giving 0 if the        */
+/* request is not one the server understands                                           */
+int    dispatch_request(SERVER *server, CONNECTION *connection);
+
+/* Sends as much of a connection's reply as the socket takes                           */
+void   send_reply(SERVER *server, CONNECTION *connection);
+
+/* Sets which events of a connection the server waits for                              */
+void   watch_connection(SERVER *server, CONNECTION *connection, unsigned events);
+
+/* Closes a connection and frees it                                                    */
+void   close_connection(SERVER *server, CONNECTION *connection);
+
+/* Answers the requests handed to it until the server stops                            */
+void   *serve_worker(void *server);
+
+/* Changes the payload of a connection's request in place and writes the reply header  */
+/* in front of it                                                                      */
+void   answer_request(SERVER *server, CONNECTION *connection);
+#endif
+
+/* Finds the cipher of a request among those kept ready, making it if it is not, or    */
+/* gives NULL with errno set when the key has no letters                               */
+ENTRY  *find_cipher(CACHE *cache, char cipher, int rotation, const char *key,
+                    size_t length);
+
+/* Gives back a cipher found in the cache, deleting it if it was dropped meanwhile     */
+void   release_cipher(CACHE *cache, ENTRY *entry);
+
+/* Takes an entry out of the cache's table and order of use                            */
+void   forget_entry(CACHE *cache, ENTRY *entry);
+
+/* Deletes every cipher in the cache                                                   */
+void   clear_cache(CACHE *cache);
+
+/* Marks that the server has been asked to stop                                        */
+void   stop_serving(int signal);
+
+/* Creates a socket listening at a path, or gives -1 with errno set                    */
+int    open_listener(const char *path);
+
+/* Connects to a socket at a path, or gives -1 with errno set                          */
+int    connect_socket(const char *path);
+
+/* Reads exactly the given number of characters, giving 0 if they do not all arrive    */
+int    read_all(int file, char *characters, size_t length);
+
+/* Sends stdin to the server as one request and writes the reply to stdout             */
+int    send_request(OPTIONS *options);
+
+/* Times a server with many small requests over several connections                    */
+int    generate_load(OPTIONS *options);
+
+/* Sends one connection's share of the load generator's requests                       */
+void   *load_task(void *load);
+
+/* Orders two times for sorting                                                        */
+int    compare_seconds(const void *first, const void *second);
+
+/* Creates a stream that applies the chosen cipher and action to one message           */
+CIPHER_STREAM *create_stream(OPTIONS *options);
+
+/* Measures how fast each cipher runs over made-up messages                            */
+int    run_benchmark(OPTIONS *options);
+
+/* Times the batch interface over many small records, each with a key of its own       */
+int    benchmark_batch(OPTIONS *options, TEXT *message, const char *corpus,
+                       unsigned long long *seed, int *first);
+
+/* Prints one benchmark record as CSV or JSON                                          */
+void   print_run(OPTIONS *options, int *first, const char *corpus, size_t size,
+                 const char *cipher, char action, size_t key_length, int threads,
+                 const char *kernel, double characters, double seconds,
+                 unsigned long long cycles, unsigned long iterations);
+
+/* Checks the ciphers against changing a message the slow way, printing each check,    */
+/* and gives 0 when every one passes                                                   */
+int    run_checks();
+
+/* Checks that chains fold to ciphers that change a message, split anywhere, as their  */
+/* stages do one after another, and that a folded key too long is refused              */
+int    check_chains();
+
+/* Fills a buffer with a made-up message of one kind                                   */
+void   fill_corpus(char *characters, size_t length, int corpus,
+                   unsigned long long *seed);
+
+/* Gives the next number of a fast, repeatable random sequence                         */
+unsigned long long next_random(unsigned long long *seed);
+
+/* Reads a clock that only ever moves forward, in seconds                              */
+double read_clock();
+
+/* Reads the processor's cycle counter, or 0 where there is none to read               */
+unsigned long long read_cycles();
+
+/* Gives the clock at the start of a stage, or 0 when the run is not measured          */
+double start_stage();
+
+/* Adds the time since the start of a stage to that stage                              */
+void   stop_stage(int stage, double started);
+
+/* Adds the characters the cipher changed, and the letters among them, to the counts   */
+void   count_characters(const char *characters, size_t length);
+
+/* Reads whether --stats or --stats=FORMAT turns on measuring, or gives 0 if it is not */
+/* one of them                                                                         */
+int    read_stats_option(char *option);
+
+/* Prints the measurements of the run to stderr as text or JSON                        */
+void   print_stats();
+
+/***************************************************************************************/
+/*                                    MAIN FUNCTION                                    */
+/***************************************************************************************/
+int    main(int argc, char *argv[]) {
+   TEXT   *message,         /* Points to the message to be encrypted or decrypted      */
+          *key;             /* Points to the key used in encrypting or decrypting      */
+   CIPHER *context;         /* Points to the cipher made from the key or rotation      */
+   char   cipher,           /* Holds the user's choice of cipher                       */
+          action;           /* Holds the user's choice of encryption or decryption     */
+   int    rotation,         /* Holds the rotation used in encrypting or decrypting     */
+          echo = 1,         /* Holds whether the original message is printed back      */
+          status = 0,       /* Holds the exit status of the program                    */
+          argument;         /* Holds the argument being read                           */
+   double started;          /* Holds the clock at the start of a stage                 */
+
+   /* Stream stdin to stdout without any prompts when options are given, other than    */
+   /* the ones turning off the echo of the original message and measuring the run      */
+   stats.started = read_clock();
+   for (argument = 1; argument < argc; argument++) {
+      if (strcmp(argv[argument], "--no-echo") == 0) {
+         echo = 0;
+      } else if (!read_stats_option(argv[argument])) {
+         return run_batch(argc, argv);
+      }
+   }
+
+   /* Greet the user                                                                   */
+   give_instructions();
+
+   /* The message and key buffers are reused by every round                            */
+   message = create_string();
+   key     = create_string();
+
+   /* Loop until the user says to stop                                                 */
+   while(user_response() == 'y') {
+
+      /* Get the cipher, action to take, message to apply, and key/rotation            */
+      cipher          = get_cipher();
+      action          = get_action();
+      message->length = 0;
+      started         = start_stage();
+      get_string(message);
+      stop_stage(READING, started);
+      if (cipher == CAESAR) {
+         get_rotation(&rotation);
+         context = cipher_create_caesar(rotation);
+      } else {
+         key->length = 0;
+         get_key(key);
+         context = cipher_create_vigenere(key->characters, key->length);
+      }
+      if (context == NULL) {
+         if (errno != EINVAL) {
+            printf("\nFailed to allocate the cipher.");
+            printf("\nExiting the program.");
+            exit(0);
+         }
+         printf("\nThe key needs at least one letter.");
+         continue;
+      }
+
+      /* Print the inputted message in its original form                               */
+      if (echo) {
+         if (action == ENCODE) {
+            printf("\nPlaintext:  ");
+         } else if (action == DECODE) {
+            printf("\nCiphertext: ");
+         }
+         print_string(message);
+      }
+
+      /* Apply the action with the chosen cipher                                       */
+      started = start_stage();
+      if (action == ENCODE) {
+         cipher_encrypt(context, message->characters, message->characters,
+                        message->length);
+      } else if (action == DECODE) {
+         cipher_decrypt(context, message->characters, message->characters,
+                        message->length);
+      } else {
+         printf("\nError with Ciphers.");
+      }
+      stop_stage(CIPHERING, started);
+      count_characters(message->characters, message->length);
+
+      /* Print the inputted message in its changed form and the key/rotation           */
+      started = start_stage();
+      status  = !print_result(action, message, context);
+      stop_stage(WRITING, started);
+      cipher_destroy(context);
+      if (status != 0) {
+         break;
+      }
+   }
+
+   /* Clear the strings                                                                */
+   started = start_stage();
+   clear_string(message);
+   clear_string(key);
+   stop_stage(CLEANING, started);
+
+   /* Give the user a farewell                                                         */
+   farewell();
+   if (stats.enabled) {
+      printf("\n");
+   }
+   print_stats();
+   
+   return status;
+}
+
+/***************************************************************************************/
+/*                                 FUNCTION DEFINITIONS                                */
+/***************************************************************************************/
+/* Gives the user instructions                                                         */
+void   give_instructions() {
+   printf("\n");
+   printf("\n");
+   printf("\nWelcome");
+   printf("\n");
+   printf("\nThis program takes in a message and either encodes into or decodes from");
+   printf("\na cipher of your choice.");
+
+   return;
+}
+
+/* Determines if the user wants to encode or decode                                    */
+char   user_response() {
+   char answer[2]; /* Holds the user's response                                        */
+
+   printf("\n");
+   printf("\nWould you like to continue (y/n)?");
+   printf("\n");
+   do {
+      printf(" >> ");
+      scanf("%1s", answer);
+      answer[0] = (char) tolower((unsigned char) answer[0]);
+   } while (answer[0] != 'y' && answer[0] != 'n');
+
+   return answer[0];
+}
+
+/* Determines which cipher the user wants to use                                       */
+char   get_cipher() {
+   char cipher[2]; /* Holds the user's response                                        */
+
+   printf("\n");
+   printf("\nWhich cipher would you like to use?");
+   printf("\n c) Caesar Cipher");
+   printf("\n v) Vigenere Cipher");
+   printf("\n");
+   do {
+      printf(" >> ");
+      scanf("%1s", cipher);
+      cipher[0] = (char) tolower((unsigned char) cipher[0]);
+   } while (cipher[0] != 'c' && cipher[0] != 'v');
+
+   return cipher[0];
+}
+
+/* Determines if the user wants to encode or decode                                    */
+char   get_action() {
+   char action[2]; /* Holds the user's response                                        */
+
+   printf("\n");
+   printf("\nWhat would you like to do?");
+   printf("\n e) Encode");
+   printf("\n d) Decode");
+   printf("\n");
+   do {
+      printf(" >> ");
+      scanf("%1s", action);
+      action[0] = (char) tolower((unsigned char) action[0]);
+   } while (action[0] != 'e' && action[0] != 'd');
+
+   return action[0];
+}
+
+/* Creates a string                                                                    */
+TEXT   *create_string() {
+   TEXT   *new_string;             /* Points to the new string                         */
+   double started = start_stage(); /* Holds the clock when the allocation started      */
+
+   /* Create the header of the string                                                  */
+   if ((new_string = (TEXT *) malloc(sizeof(TEXT))) == NULL) {
+      printf("\nFailed to allocate the header of the string.");
+      printf("\nExiting the program.");
+      exit(0);
+   }
+
+   /* Create the buffer of the string                                                  */
+   if ((new_string->characters = (char *) malloc(START_SIZE + 1)) == NULL) {
+      printf("\nFailed to allocate the buffer of the string.");
+      printf("\nExiting the program.");
+      exit(0);
+   }
+   new_string->characters[0] = '\0';
+   new_string->length        = 0;
+   new_string->capacity      = START_SIZE;
+
+   stats.allocations += 2;
+   stats.allocated   += sizeof(TEXT) + START_SIZE + 1;
+   stop_stage(ALLOCATING, started);
+
+   return new_string;
+}
+
+/* Makes room in a string for at least the given number of characters                  */
+void   reserve_string(TEXT *text, size_t capacity) {
+   char   *new_characters; /* Points to the enlarged buffer of the string              */
+   double started;         /* Holds the clock when the allocation started              */
+
+   if (capacity > text->capacity) {
+      started = start_stage();
+      if ((new_characters = (char *) realloc(text->characters, capacity + 1)) == NULL) {
+         printf("\nFailed to enlarge the buffer of the string.");
+         printf("\nExiting the program.");
+         exit(0);
+      }
+      text->characters = new_characters;
+      text->capacity   = capacity;
+      stats.allocations++;
+      stats.allocated += capacity + 1;
+      stop_stage(ALLOCATING, started);
+   }
+
+   return;
+}
+
+/* Adds a character to the end of a string                                             */
+void   add_character(TEXT *text, char new_character) {
+
+   /* Double the buffer when it is full so adding a character is amortized constant    */
+   if (text->length == text->capacity) {
+      reserve_string(text, text->capacity * 2);
+   }
+   text->characters[text->length++] = new_character;
+   text->characters[text->length]   = '\0';
+
+   return;
+}
+
+/* Get the rotation for the caesar cipher                                              */
+void   get_rotation(int *rotation) {
+   printf("\nEnter a rotation: ");
+   printf("\n");
+   scanf("%d", rotation);
+
+   return;
+}
+
+/* Get the key for the vigenere cipher                                                 */
+void   get_key(TEXT *key) {
+   int  new_character; /* Holds the character to be added to the string                */
+
+   printf("\nEnter the key: ");
+   printf("\n");
+   printf(" >> ");
+   scanf(" ");
+   while ((new_character = getchar()) != '\n' && new_character != EOF) {
+      add_character(key, new_character);
+   }
+
+   return;
+}
+
+/* Gets a string from the user                                                         */
+void   get_string(TEXT *text) {
+   int  new_character; /* Holds the character to be added to the string                */
+
+   printf("\nEnter the message: ");
+   printf("\n >> ");
+   scanf(" ");
+   while ((new_character = getchar()) != '\n' && new_character != EOF) {
+      add_character(text, new_character);
+   }
+
+   return;
+}
+
+/* Prints a string                                                                     */
+void   print_string(TEXT *text) {
+   double started = start_stage(); /* Holds the clock when the write started           */
+
+   fwrite(text->characters, 1, text->length, stdout);
+   stop_stage(WRITING, started);
+
+   return;
+}
+
+/* Prints the changed message and its key or rotation with a single write, and gives 0 */
+/* when it could not be written                                                        */
+int    print_result(char action, TEXT *message, CIPHER *context) {
+   struct iovec pieces[4];   /* Holds the pieces of the result in order                */
+   char         number[32];  /* Holds the rotation written out                         */
+   int          count = 0;   /* Holds the number of pieces                             */
+
+   pieces[count].iov_base = action == ENCODE ? "\nCiphertext: " : "\nPlaintext:  ";
+   pieces[count].iov_len  = strlen(pieces[count].iov_base);
+   count++;
+   pieces[count].iov_base = message->characters;
+   pieces[count].iov_len  = message->length;
+   count++;
+   if (cipher_key(context)[0] == '\0') {
+      snprintf(number, sizeof(number), "\nRotation:   %d", cipher_rotation(context));
+      pieces[count].iov_base = number;
+      pieces[count].iov_len  = strlen(number);
+      count++;
+   } else {
+      pieces[count].iov_base = "\nKey:        ";
+      pieces[count].iov_len  = strlen(pieces[count].iov_base);
+      count++;
+      pieces[count].iov_base = (char *) cipher_key(context);
+      pieces[count].iov_len  = strlen(cipher_key(context));
+      count++;
+   }
+
+   /* Anything printf() is holding has to go out first to keep the order               */
+   fflush(stdout);
+   if (!write_vector(STDOUT_FILENO, pieces, count)) {
+      fprintf(stderr, "Failed to write the message: %s\n", strerror(errno));
+      return 0;
+   }
+
+   return 1;
+}
+
+/* Writes a whole buffer to a file descriptor, however many calls it takes             */
+int    write_all(int file, const char *characters, size_t length) {
+   ssize_t written; /* Holds the number of characters one call wrote                   */
+
+   while (length > 0) {
+      if ((written = write(file, characters, length)) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return 0;
+      }
+      characters += written;
+      length     -= (size_t) written;
+   }
+
+   return 1;
+}
+
+/* Writes several buffers to a file descriptor with as few calls as possible           */
+int    write_vector(int file, struct iovec *pieces, int count) {
+   ssize_t written; /* Holds the number of characters one call wrote                   */
+
+   while (count > 0) {
+      written = writev(file, pieces, count > VECTOR_CAP ? VECTOR_CAP : count);
+      if (written < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return 0;
+      }
+
+      /* Skip the pieces written whole and move into the one written in part           */
+      while (count > 0 && (size_t) written >= pieces->iov_len) {
+         written -= (ssize_t) pieces->iov_len;
+         pieces++;
+         count--;
+      }
+      if (count > 0) {
+         pieces->iov_base  = (char *) pieces->iov_base + written;
+         pieces->iov_len  -= (size_t) written;
+      }
+   }
+
+   return 1;
+}
+
+/* Deletes a string                                                                    */
+void   clear_string(TEXT *text) {
+   free(text->characters);
+   free(text);
+
+   return;
+}
+
+/* Tells the user goodbye                                                              */
+void   farewell() {
+   printf("\nThank you for using the program!");
+
+   return;
+}
+
+/* Runs the program without prompts, streaming stdin to stdout                         */
+int    run_batch(int argc, char *argv[]) {
+   OPTIONS options; /* Holds the choices given on the command line                     */
+   int     status;  /* Holds the exit status of the program                            */
+   double  started; /* Holds the clock when the teardown started                       */
+
+   if (!parse_options(argc, argv, &options)) {
+      give_usage(argv[0]);
+      status = 1;
+   } else if (options.benchmark) {
+      status = run_benchmark(&options);
+   } else if (options.action == CHECK) {
+      status = run_checks();
+   } else if (options.action == CRACK) {
+      status = crack_message(&options);
+   } else if (options.action == TRAIN) {
+      status = train_quadgrams(&options);
+   } else if (options.action == SERVE) {
+      status = serve_requests(&options);
+   } else if (options.action == LOAD_TEST) {
+      status = generate_load(&options);
+   } else if (options.socket_path != NULL) {
+      status = send_request(&options);
+   } else if (options.input_file != NULL && is_directory(options.input_file)) {
+      status = cipher_tree(&options);
+   } else if (options.input_file != NULL) {
+      status = cipher_file(&options);
+   } else {
+      status = stream_message(&options);
+   }
+   started = start_stage();
+   cipher_destroy(options.context);
+   stop_stage(CLEANING, started);
+   print_stats();
+
+   return status;
+}
+
+/* Reads the command line into the options                                             */
+int    parse_options(int argc, char *argv[], OPTIONS *options) {
+   char   *end;              /* Points past the number read from an argument           */
+   long   number;            /* Holds the number read, before its range is checked     */
+   int    argument,          /* Holds the argument being read                          */
+          has_rotation = 0;  /* Holds whether a rotation was given                     */
+
+   options->cipher      = NEITHER;
+   options->action      = NEITHER;
+   options->rotation    = 0;
+   options->threads     = 1;
+   options->in_place    = 0;
+   options->key         = NULL;
+   options->context     = NULL;
+   options->input_file  = NULL;
+   options->output_file = NULL;
+   options->quadgrams   = NULL;
+   options->chain       = NULL;
+   options->benchmark   = 0;
+   options->json        = 0;
+   options->max_size    = (size_t) 1 << 30;
+   options->sample      = SAMPLE_CAP;
+   options->longest     = KEY_CAP;
+   options->io          = IO_AUTO;
+   options->socket_path = NULL;
+   options->requests    = 100000;
+   options->payload     = BENCH_MIN;
+   options->cache_size  = CACHE_CAP;
+   options->connections = 4;
+
+   /* Read each option and the value following it                                      */
+   for (argument = 1; argument < argc; argument++) {
+      if (strcmp(argv[argument], "-c") == 0 && argument + 1 < argc) {
+         argument++;
+         if (strcmp(argv[argument], "caesar") == 0 || strcmp(argv[argument], "c") == 0) {
+            options->cipher = CAESAR;
+         } else if (strcmp(argv[argument], "vigenere") == 0 ||
+                    strcmp(argv[argument], "v") == 0) {
+            options->cipher = VIGENERE;
+         } else {
+            fprintf(stderr, "Unknown cipher: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "-e") == 0) {
+         options->action = ENCODE;
+      } else if (strcmp(argv[argument], "-d") == 0) {
+         options->action = DECODE;
+      } else if (strcmp(argv[argument], "--crack") == 0) {
+         options->action = CRACK;
+      } else if (strcmp(argv[argument], "--train-quadgrams") == 0 &&
+                 argument + 1 < argc) {
+         options->action    = TRAIN;
+         options->quadgrams = argv[++argument];
+      } else if (strcmp(argv[argument], "--quadgrams") == 0 && argument + 1 < argc) {
+         options->quadgrams = argv[++argument];
+      } else if (strcmp(argv[argument], "-r") == 0 && argument + 1 < argc) {
+         argument++;
+         errno = 0;
+         number = strtol(argv[argument], &end, 10);
+         if (end == argv[argument] || *end != '\0' || errno == ERANGE ||
+             number < INT_MIN || number > INT_MAX) {
+            fprintf(stderr, "Invalid rotation: %s\n", argv[argument]);
+            return 0;
+         }
+         options->rotation = (int) number;
+         has_rotation = 1;
+      } else if ((strcmp(argv[argument], "-t") == 0 ||
+                  strcmp(argv[argument], "--threads") == 0) && argument + 1 < argc) {
+         argument++;
+         errno  = 0;
+         number = strtol(argv[argument], &end, 10);
+         if (end == argv[argument] || *end != '\0' || errno == ERANGE ||
+             number < 0 || number > CIPHER_MAX_THREADS) {
+            fprintf(stderr, "Invalid number of threads: %s\n", argv[argument]);
+            return 0;
+         }
+         options->threads = (int) number;
+      } else if (strcmp(argv[argument], "-i") == 0 && argument + 1 < argc) {
+         options->input_file = argv[++argument];
+      } else if (strcmp(argv[argument], "-o") == 0 && argument + 1 < argc) {
+         options->output_file = argv[++argument];
+      } else if (strcmp(argv[argument], "--in-place") == 0) {
+         options->in_place = 1;
+      } else if (read_stats_option(argv[argument])) {
+         continue;
+      } else if (strcmp(argv[argument], "--benchmark") == 0) {
+         options->benchmark = 1;
+      } else if (strcmp(argv[argument], "--check") == 0) {
+         options->action = CHECK;
+      } else if (strcmp(argv[argument], "--format") == 0 && argument + 1 < argc) {
+         argument++;
+         if (strcmp(argv[argument], "json") == 0 || strcmp(argv[argument], "csv") == 0) {
+            options->json = strcmp(argv[argument], "json") == 0;
+         } else {
+            fprintf(stderr, "Unknown format: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--max-size") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->max_size = read_size(argv[argument])) < BENCH_MIN) {
+            fprintf(stderr, "Invalid size: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--sample") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->sample = read_size(argv[argument])) == 0) {
+            fprintf(stderr, "Invalid sample: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--max-key") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->longest = read_size(argv[argument])) == 0) {
+            fprintf(stderr, "Invalid key length: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--io") == 0 && argument + 1 < argc) {
+         argument++;
+         if (strcmp(argv[argument], "auto") == 0 ||
+             strcmp(argv[argument], "uring") == 0 ||
+             strcmp(argv[argument], "threads") == 0 ||
+             strcmp(argv[argument], "serial") == 0) {
+            options->io = argv[argument][0];
+         } else {
+            fprintf(stderr, "Unknown I/O mode: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--serve") == 0 && argument + 1 < argc) {
+         options->action      = SERVE;
+         options->socket_path = argv[++argument];
+      } else if (strcmp(argv[argument], "--load") == 0 && argument + 1 < argc) {
+         options->action      = LOAD_TEST;
+         options->socket_path = argv[++argument];
+      } else if (strcmp(argv[argument], "--connect") == 0 && argument + 1 < argc) {
+         options->socket_path = argv[++argument];
+      } else if (strcmp(argv[argument], "--cache") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->cache_size = read_size(argv[argument])) == 0) {
+            fprintf(stderr, "Invalid cache size: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--requests") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->requests = read_size(argv[argument])) == 0) {
+            fprintf(stderr, "Invalid number of requests: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--size") == 0 && argument + 1 < argc) {
+         argument++;
+         if ((options->payload = read_size(argv[argument])) == 0 ||
+             options->payload > SERVE_CAP) {
+            fprintf(stderr, "Invalid size: %s\n", argv[argument]);
+            return 0;
+         }
+      } else if (strcmp(argv[argument], "--connections") == 0 && argument + 1 < argc) {
+         argument++;
+         errno  = 0;
+         number = strtol(argv[argument], &end, 10);
+         if (end == argv[argument] || *end != '\0' || errno == ERANGE ||
+             number < 1 || number > CIPHER_MAX_THREADS) {
+            fprintf(stderr, "Invalid number of connections: %s\n", argv[argument]);
+            return 0;
+         }
+         options->connections = (int) number;
+      } else if (strcmp(argv[argument], "-k") == 0 && argument + 1 < argc) {
+         options->key = argv[++argument];
+      } else if (strcmp(argv[argument], "--chain") == 0 && argument + 1 < argc) {
+         options->chain = argv[++argument];
+      } else {
+         fprintf(stderr, "Unknown option: %s\n", argv[argument]);
+         return 0;
+      }
+   }
+
+   /* A benchmark or a check picks its own ciphers, and a server or load generator     */
+   /* takes them from each request                                                     */
+   if (options->benchmark || options->action == CHECK || options->action == SERVE ||
+       options->action == LOAD_TEST) {
+      return 1;
+   }
+
+   /* A quadgram table is built from stdin or a file and needs no cipher               */
+   if (options->action == TRAIN) {
+      if (options->output_file != NULL || options->in_place) {
+         fprintf(stderr, "The quadgram table is written to the file after "
+                         "--train-quadgrams.\n");
+         return 0;
+      }
+      return 1;
+   }
+
+   /* Make sure the options are enough to apply the cipher                             */
+   if ((options->cipher == NEITHER && options->chain == NULL) ||
+       options->action == NEITHER) {
+      fprintf(stderr, "A cipher and an action are required.\n");
+      return 0;
+   }
+   if (options->chain != NULL && (options->cipher != NEITHER || has_rotation ||
+                                  options->key != NULL || options->action == CRACK)) {
+      fprintf(stderr, "A chain takes the place of -c, -r and -k and cannot be "
+                      "cracked.\n");
+      return 0;
+   }
+
+   /* Cracking finds the rotation or key itself and reads and writes stdin, stdout     */
+   /* or files                                                                         */
+   if (options->action == CRACK) {
+      if (options->in_place) {
+         fprintf(stderr, "Cracking cannot change a file in place.\n");
+         return 0;
+      }
+      return 1;
+   }
+   if (options->cipher == CAESAR && !has_rotation) {
+      fprintf(stderr, "The caesar cipher needs a rotation.\n");
+      return 0;
+   }
+   if (options->cipher == VIGENERE && options->key == NULL) {
+      fprintf(stderr, "The vigenere cipher needs a key.\n");
+      return 0;
+   }
+   if (options->input_file == NULL &&
+       (options->output_file != NULL || options->in_place)) {
+      fprintf(stderr, "An output file or --in-place needs an input file.\n");
+      return 0;
+   }
+   if (options->input_file != NULL && options->output_file == NULL &&
+       !options->in_place) {
+      fprintf(stderr, "An input file needs an output file or --in-place.\n");
+      return 0;
+   }
+   if (options->output_file != NULL && options->in_place) {
+      fprintf(stderr, "Choose either an output file or --in-place.\n");
+      return 0;
+   }
+   if (options->socket_path != NULL && options->input_file != NULL) {
+      fprintf(stderr, "--connect sends stdin and writes the reply to stdout.\n");
+      return 0;
+   }
+
+   /* Make the cipher once, now that everything it needs is known. A chain folds into  */
+   /* one caesar or vigenere cipher, which the rest of the run then uses.              */
+   if (options->chain != NULL) {
+      if ((options->context = create_chain(options->chain)) == NULL) {
+         return 0;
+      }
+      options->key      = (char *) cipher_key(options->context);
+      options->rotation = cipher_rotation(options->context);
+      options->cipher   = options->key[0] != '\0' ? VIGENERE : CAESAR;
+   } else {
+      options->context = options->cipher == CAESAR
+                            ? cipher_create_caesar(options->rotation)
+                            : cipher_create_vigenere(options->key, strlen(options->key));
+      if (options->context == NULL) {
+         fprintf(stderr, errno == EINVAL ? "The key needs at least one letter.\n"
+                                         : "Failed to allocate the cipher.\n");
+         return 0;
+      }
+   }
+   options->threads = cipher_set_threads(options->context, options->threads);
+
+   return 1;
+}
+
+/* Reads a number of characters, allowing a K, M or G after it, or 0 if it is invalid  */
+size_t read_size(char *text) {
+   char               *end;      /* Points past the number read                        */
+   unsigned long long size;      /* Holds the number read                              */
+   int                shift = 0; /* Holds the bits the suffix moves it up by           */
+
+   errno = 0;
+   size  = strtoull(text, &end, 10);
+   if (end == text || text[0] == '-' || errno == ERANGE) {
+      return 0;
+   }
+   if (*end == 'k' || *end == 'K') {
+      shift = 10;
+      end++;
+   } else if (*end == 'm' || *end == 'M') {
+      shift = 20;
+      end++;
+   } else if (*end == 'g' || *end == 'G') {
+      shift = 30;
+      end++;
+   }
+
+   /* A size the suffix would carry past the top of a size_t is as invalid as junk     */
+   if (*end != '\0' || size > (ULLONG_MAX >> shift) || (size << shift) > SIZE_MAX) {
+      return 0;
+   }
+
+   return (size_t) (size << shift);
+}
+
+/* Makes the one cipher that a chain such as caesar:3,vigenere:lemon,rot13 folds to    */
+CIPHER *create_chain(const char *spec) {
+   CIPHER     *stages[CHAIN_CAP], /* Points to the cipher of each stage                */
+              *chain = NULL;      /* Points to the cipher the stages fold to           */
+   const char *stage = spec,      /* Points to the stage being read                    */
+              *value;             /* Points to the colon before its value, or NULL     */
+   char       *end;               /* Points past the rotation read                     */
+   size_t     length,             /* Holds the number of characters in the stage       */
+              name;               /* Holds the number of characters in its name        */
+   long       rotation;           /* Holds the rotation of a caesar stage              */
+   int        count = 0,          /* Holds the number of stages made                   */
+              failed = 0,         /* Holds whether a stage could not be made           */
+              index;              /* Holds the stage being deleted                     */
+
+   /* Make a cipher of each stage, up to the next comma                                */
+   do {
+      length = strcspn(stage, ",");
+      value  = (const char *) memchr(stage, ':', length);
+      name   = value == NULL ? length : (size_t) (value - stage);
+      if (count == CHAIN_CAP) {
+         fprintf(stderr, "A chain has at most %d stages.\n", CHAIN_CAP);
+         failed = 1;
+         break;
+      }
+      stages[count] = NULL;
+      if (value == NULL && name == 5 && strncmp(stage, "rot13", 5) == 0) {
+         stages[count] = cipher_create_caesar(13);
+      } else if (value != NULL && ((name == 6 && strncmp(stage, "caesar", 6) == 0) ||
+                                   (name == 1 && stage[0] == 'c'))) {
+         errno    = 0;
+         rotation = strtol(value + 1, &end, 10);
+         if (end != value + 1 && end == stage + length && errno != ERANGE &&
+             rotation >= INT_MIN && rotation <= INT_MAX) {
+            stages[count] = cipher_create_caesar((int) rotation);
+         }
+      } else if (value != NULL && ((name == 8 && strncmp(stage, "vigenere", 8) == 0) ||
+                                   (name == 1 && stage[0] == 'v'))) {
+         stages[count] = cipher_create_vigenere(value + 1,
+                                                (size_t) (stage + length - value - 1));
+      }
+      if (stages[count] == NULL) {
+         fprintf(stderr, "Invalid chain stage: %.*s\n", (int) length, stage);
+         failed = 1;
+         break;
+      }
+      count++;
+      stage += length;
+   } while (*stage++ == ',');
+
+   /* Fold the stages into one cipher once every one of them is made                   */
+   if (!failed) {
+      if ((chain = cipher_create_chain((const CIPHER *const *) stages,
+                                       (size_t) count)) == NULL) {
+         fprintf(stderr, errno == E2BIG ? "The chain's key is too long.\n"
+                                        : "Failed to allocate the cipher.\n");
+      }
+   }
+   for (index = 0; index < count; index++) {
+      cipher_destroy(stages[index]);
+   }
+
+   return chain;
+}
+
+/* Tells the user how to use the command line                                          */
+void   give_usage(char *program) {
+   fprintf(stderr, "Usage: %s -c caesar   -e|-d -r ROTATION < in > out\n", program);
+   fprintf(stderr, "       %s -c vigenere -e|-d -k KEY      < in > out\n", program);
+   fprintf(stderr, "       %s --chain c:N,v:KEY,rot13,... -e|-d < in > out\n",
+           program);
+   fprintf(stderr, "       %s -c CIPHER -e|-d ... -i IN -o OUT | -i FILE --in-place\n",
+           program);
+   fprintf(stderr, "An IN that is a directory is copied whole to the directory OUT.\n");
+   fprintf(stderr, "       %s -c CIPHER --crack [-i IN] [-o OUT] < in > out\n", program);
+   fprintf(stderr, "       %s -c vigenere --crack [--sample SIZE] [--max-key N]\n",
+           program);
+   fprintf(stderr, "       %s --train-quadgrams TABLE [-i CORPUS] < corpus\n", program);
+   fprintf(stderr, "Add --quadgrams TABLE to --crack to rank guesses by quadgrams.\n");
+   fprintf(stderr, "Add --stats or --stats=json to report where the time went.\n");
+   fprintf(stderr, "       %s --benchmark [--format csv|json] [--max-size SIZE]\n",
+           program);
+   fprintf(stderr, "       %s --check\n", program);
+   fprintf(stderr, "       %s --serve SOCKET [--cache N] [-t N]\n", program);
+   fprintf(stderr, "       %s -c CIPHER -e|-d ... --connect SOCKET < in > out\n",
+           program);
+   fprintf(stderr, "       %s --load SOCKET [--requests N] [--connections N] "
+                   "[--size SIZE]\n", program);
+   fprintf(stderr, "Add -t N or --threads N to split the work between N threads, ");
+   fprintf(stderr, "0 for one per processor.\n");
+   fprintf(stderr, "Add --io auto|uring|threads|serial to choose how stdin and stdout ");
+   fprintf(stderr, "overlap.\n");
+   fprintf(stderr, "Without options the program asks for everything interactively; ");
+   fprintf(stderr, "--no-echo alone\nkeeps it from printing the message back first.\n");
+
+   return;
+}
+
+/* Applies the chosen cipher to stdin chunk by chunk and writes the result to stdout   */
+int    stream_message(OPTIONS *options) {
+   TEXT          *message; /* Points to the chunk of the message being changed         */
+   CIPHER_STREAM *stream;  /* Holds the position in the key across chunks              */
+   int           status;   /* Holds the exit status of the program                     */
+
+   /* Read a large enough chunk for every thread to get a share of it                  */
+   stream = create_stream(options);
+   if (options->io != IO_SERIAL) {
+      status = pipe_stream(STDIN_FILENO, STDOUT_FILENO, stream,
+                           options->threads > 1 ? (size_t) options->threads * SHARE_SIZE
+                                                : PIPE_CHUNK, options->io);
+      cipher_stream_destroy(stream);
+      return status;
+   }
+   message = create_string();
+   reserve_string(message, options->threads > 1 ? (size_t) options->threads * SHARE_SIZE
+                                                : CHUNK_SIZE);
+
+   status = pump_stream(stdin, STDOUT_FILENO, stream, message);
+
+   clear_string(message);
+   cipher_stream_destroy(stream);
+
+   return status;
+}
+
+/* Changes a message chunk by chunk through a stream, reading it from a file and       */
+/* writing it to a descriptor, and gives the exit status of the program                */
+int    pump_stream(FILE *input, int output, CIPHER_STREAM *stream, TEXT *message) {
+   double started = start_stage(); /* Holds the clock at the start of a stage          */
+
+   /* Change each chunk in turn, carrying the position in the key to the next one      */
+   while ((message->length =
+              fread(message->characters, 1, message->capacity, input)) > 0) {
+      stop_stage(READING, started);
+      started = start_stage();
+      cipher_stream_update(stream, message->characters, message->characters,
+                           message->length);
+      stop_stage(CIPHERING, started);
+      count_characters(message->characters, message->length);
+
+      started = start_stage();
+      if (!write_all(output, message->characters, message->length)) {
+         fprintf(stderr, "Failed to write the message: %s\n", strerror(errno));
+         return 1;
+      }
+      stop_stage(WRITING, started);
+      started = start_stage();
+   }
+   stop_stage(READING, started);
+   if (ferror(input)) {
+      fprintf(stderr, "Failed to read the message.\n");
+      return 1;
+   }
+
+   return 0;
+}
+
+/* Changes a message through a stream with reading, changing and writing overlapped    */
+/* The ring of buffers is allocated once. The chunks are changed on the calling thread */
+/* while their reads and writes run on an io_uring or, where there is none, on a       */
+/* reader thread and a writer thread, so a run takes as long as the slowest of the     */
+/* three rather than all of them added up.                                             */
+int    pipe_stream(int input, int output, CIPHER_STREAM *stream, size_t chunk, char io) {
+   PIPELINE pipeline; /* Holds the ring and how far each stage has got                 */
+   TEXT     *ring;    /* Points to the buffers of the ring                             */
+   int      flags[2]; /* Holds the flags the input and output had before the run       */
+#ifdef LINUX_URING
+   URING    uring;    /* Holds the io_uring the transfers run on                       */
+#endif
+
+   ring = create_string();
+   reserve_string(ring, chunk * PIPE_DEPTH);
+   pipeline.stream      = stream;
+   pipeline.buffers     = ring->characters;
+   pipeline.chunk       = chunk;
+   pipeline.filled      = 0;
+   pipeline.changed     = 0;
+   pipeline.written     = 0;
+   pipeline.input       = input;
+   pipeline.output      = output;
+   pipeline.ended       = 0;
+   pipeline.read_error  = 0;
+   pipeline.write_error = 0;
+
+   /* A non-blocking descriptor gives back EAGAIN for every transfer tried while it    */
+   /* is not ready, so both are made to block for the run and put back afterwards      */
+   flags[0] = fcntl(input, F_GETFL);
+   flags[1] = fcntl(output, F_GETFL);
+   if (flags[0] != -1 && (flags[0] & O_NONBLOCK)) {
+      fcntl(input, F_SETFL, flags[0] & ~O_NONBLOCK);
+   }
+   if (flags[1] != -1 && (flags[1] & O_NONBLOCK)) {
+      fcntl(output, F_SETFL, flags[1] & ~O_NONBLOCK);
+   }
+
+   /* Use io_uring when it can be set up, unless told to use threads                   */
+#ifdef LINUX_URING
+   if (io != IO_THREADS && open_uring(&uring) == 0) {
+      run_uring(&pipeline, &uring);
+      close_uring(&uring);
+      io = IO_SERIAL;
+   }
+#endif
+   if (io == IO_URING) {
+      fprintf(stderr, "io_uring is not available here.\n");
+   } else if (io != IO_SERIAL) {
+      run_threads(&pipeline);
+   }
+   clear_string(ring);
+   if (flags[0] != -1 && (flags[0] & O_NONBLOCK)) {
+      fcntl(input, F_SETFL, flags[0]);
+   }
+   if (flags[1] != -1 && (flags[1] & O_NONBLOCK)) {
+      fcntl(output, F_SETFL, flags[1]);
+   }
+   if (io == IO_URING) {
+      return 1;
+   }
+
+   if (pipeline.write_error != 0) {
+      fprintf(stderr, "Failed to write the message: %s\n",
+              strerror(pipeline.write_error));
+      return 1;
+   }
+   if (pipeline.read_error != 0) {
+      fprintf(stderr, "Failed to read the message: %s\n", strerror(pipeline.read_error));
+      return 1;
+   }
+
+   return 0;
+}
+
+/* Changes the oldest chunk of the pipeline that has been read but not changed         */
+void   change_chunk(PIPELINE *pipeline) {
+   char   *buffer = pipeline->buffers + pipeline->changed % PIPE_DEPTH * pipeline->chunk;
+                                   /* Points to the chunk's buffer                     */
+   size_t length  = pipeline->lengths[pipeline->changed % PIPE_DEPTH];
+                                   /* Holds the characters in the chunk                */
+   double started = start_stage(); /* Holds the clock when the change started          */
+
+   cipher_stream_update(pipeline->stream, buffer, buffer, length);
+   stop_stage(CIPHERING, started);
+   count_characters(buffer, length);
+
+   return;
+}
+
+/* Runs the pipeline with a reader thread and a writer thread                          */
+/* The calling thread changes the chunks between them, and all three wait on the one   */
+/* condition whenever the stage before them has nothing new.                           */
+void   run_threads(PIPELINE *pipeline) {
+   pthread_t reader,  /* Holds the thread reading chunks                               */
+             writer;  /* Holds the thread writing chunks                               */
+   int       started; /* Holds how many of the two threads were started                */
+
+   pthread_mutex_init(&pipeline->lock, NULL);
+   pthread_cond_init(&pipeline->moved, NULL);
+   started = pthread_create(&reader, NULL, read_chunks, pipeline) == 0;
+   if (started == 1) {
+      started += pthread_create(&writer, NULL, write_chunks, pipeline) == 0;
+   }
+
+   /* Change each chunk as soon as it has been read                                    */
+   pthread_mutex_lock(&pipeline->lock);
+   if (started < 2) {
+      pipeline->read_error = EAGAIN;
+   }
+   while (pipeline->read_error == 0 && pipeline->write_error == 0) {
+      if (pipeline->changed == pipeline->filled) {
+         if (pipeline->ended) {
+            break;
+         }
+         pthread_cond_wait(&pipeline->moved, &pipeline->lock);
+         continue;
+      }
+      pthread_mutex_unlock(&pipeline->lock);
+      change_chunk(pipeline);
+      pthread_mutex_lock(&pipeline->lock);
+      pipeline->changed++;
+      pthread_cond_broadcast(&pipeline->moved);
+   }
+   pthread_cond_broadcast(&pipeline->moved);
+   pthread_mutex_unlock(&pipeline->lock);
+
+   /* A reader stuck waiting on input that will never be used is stopped               */
+   if (started >= 1) {
+      if (pipeline->write_error != 0 || started < 2) {
+         pthread_cancel(reader);
+      }
+      pthread_join(reader, NULL);
+   }
+   if (started == 2) {
+      pthread_join(writer, NULL);
+   }
+   pthread_cond_destroy(&pipeline->moved);
+   pthread_mutex_destroy(&pipeline->lock);
+
+   return;
+}
+
+/* Reads chunks into free buffers until the input ends                                 */
+void   *read_chunks(void *task) {
+   PIPELINE *pipeline = (PIPELINE *) task; /* Points to the pipeline being fed         */
+   ssize_t  length;                        /* Holds the characters one read gave       */
+   double   started;                       /* Holds the clock when the read started    */
+   int      error = 0;                     /* Holds the error the read gave            */
+
+   /* The reader may be cancelled in the wait, which takes the lock back first, or in  */
+   /* the read, which runs without it, so only the wait unlocks when cancelled         */
+   pthread_mutex_lock(&pipeline->lock);
+   while (!pipeline->ended && pipeline->read_error == 0 && pipeline->write_error == 0) {
+      if (pipeline->filled - pipeline->written == PIPE_DEPTH) {
+         pthread_cleanup_push(unlock_pipeline, pipeline);
+         pthread_cond_wait(&pipeline->moved, &pipeline->lock);
+         pthread_cleanup_pop(0);
+         continue;
+      }
+
+      /* The buffer is free, so it can be read into without holding the lock           */
+      pthread_mutex_unlock(&pipeline->lock);
+      started = start_stage();
+      do {
+         length = read(pipeline->input, pipeline->buffers +
+                       pipeline->filled % PIPE_DEPTH * pipeline->chunk, pipeline->chunk);
+      } while (length < 0 && errno == EINTR);
+      error = errno;
+      stop_stage(READING, started);
+      pthread_mutex_lock(&pipeline->lock);
+
+      if (length < 0) {
+         pipeline->read_error = error;
+      } else if (length == 0) {
+         pipeline->ended = 1;
+      } else {
+         pipeline->lengths[pipeline->filled % PIPE_DEPTH] = (size_t) length;
+         pipeline->filled++;
+      }
+      pthread_cond_broadcast(&pipeline->moved);
+   }
+   pthread_mutex_unlock(&pipeline->lock);
+
+   return NULL;
+}
+
+/* Unlocks the pipeline when its reader is cancelled while waiting for a free buffer   */
+void   unlock_pipeline(void *pipeline) {
+   pthread_mutex_unlock(&((PIPELINE *) pipeline)->lock);
+
+   return;
+}
+
+/* Writes changed chunks in order until every chunk read is written                    */
+void   *write_chunks(void *task) {
+   PIPELINE *pipeline = (PIPELINE *) task; /* Points to the pipeline being drained     */
+   size_t   slot;                          /* Holds the buffer being written           */
+   double   started;                       /* Holds the clock when the write started   */
+   int      written;                       /* Holds whether the whole chunk went out   */
+
+   pthread_mutex_lock(&pipeline->lock);
+   while (pipeline->write_error == 0 && pipeline->read_error == 0) {
+      if (pipeline->written == pipeline->changed) {
+         if (pipeline->ended && pipeline->changed == pipeline->filled) {
+            break;
+         }
+         pthread_cond_wait(&pipeline->moved, &pipeline->lock);
+         continue;
+      }
+      slot = pipeline->written % PIPE_DEPTH;
+      pthread_mutex_unlock(&pipeline->lock);
+      started = start_stage();
+      written = write_all(pipeline->output, pipeline->buffers + slot * pipeline->chunk,
+                          pipeline->lengths[slot]);
+      stop_stage(WRITING, started);
+      pthread_mutex_lock(&pipeline->lock);
+
+      if (!written) {
+         pipeline->write_error = errno;
+      } else {
+         pipeline->written++;
+      }
+      pthread_cond_broadcast(&pipeline->moved);
+   }
+   pthread_mutex_unlock(&pipeline->lock);
+
+   return NULL;
+}
+
+#ifdef LINUX_URING
+/* Sets up an io_uring, giving 0, or -1 with errno set when the system has none        */
+/* The rings are mapped straight from the kernel, so no library is needed for them.    */
+int    open_uring(URING *ring) {
+   struct io_uring_params params; /* Holds the sizes and offsets the kernel gives      */
+   int                    error;  /* Holds the error from mapping the rings            */
+
+   memset(&params, 0, sizeof(params));
+   if ((ring->file = (int) syscall(__NR_io_uring_setup, PIPE_DEPTH * 2, &params)) < 0) {
+      return -1;
+   }
+
+   /* Reads and writes of pipes need the kernel to keep the position itself            */
+   ring->sq_ring = MAP_FAILED;
+   ring->cq_ring = MAP_FAILED;
+   ring->sqes    = MAP_FAILED;
+   ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      ring->sq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+      ring->cq_size = ring->sq_size;
+   }
+   ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+   if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+      close_uring(ring);
+      errno = ENOSYS;
+      return -1;
+   }
+
+   /* Map the rings, which are one mapping on newer kernels                            */
+   ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->file, IORING_OFF_SQ_RING);
+   ring->cq_ring = params.features & IORING_FEAT_SINGLE_MMAP
+                      ? ring->sq_ring
+                      : mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->file, IORING_OFF_CQ_RING);
+   ring->sqes    = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->file, IORING_OFF_SQES);
+   if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+       ring->sqes == MAP_FAILED) {
+      error = errno;
+      close_uring(ring);
+      errno = error;
+      return -1;
+   }
+
+   ring->sq_tail  = (unsigned *) ((char *) ring->sq_ring + params.sq_off.tail);
+   ring->sq_mask  = (unsigned *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+   ring->sq_array = (unsigned *) ((char *) ring->sq_ring + params.sq_off.array);
+   ring->cq_head  = (unsigned *) ((char *) ring->cq_ring + params.cq_off.head);
+   ring->cq_tail  = (unsigned *) ((char *) ring->cq_ring + params.cq_off.tail);
+   ring->cq_mask  = (unsigned *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+   ring->cqes     = (struct io_uring_cqe *) ((char *) ring->cq_ring +
+                                            params.cq_off.cqes);
+   ring->queued   = 0;
+
+   return 0;
+}
+
+/* Adds a read or write at the current position of a descriptor to the ring            */
+void   queue_transfer(URING *ring, int operation, int file, char *buffer, size_t length,
+                      unsigned long long tag) {
+   unsigned            tail,  /* Holds the place of the new submission                 */
+                       index; /* Holds the entry the submission is written into        */
+   struct io_uring_sqe *entry; /* Points to that entry                                 */
+
+   tail  = *ring->sq_tail;
+   index = tail & *ring->sq_mask;
+   entry = &ring->sqes[index];
+   memset(entry, 0, sizeof(*entry));
+   entry->opcode    = (unsigned char) operation;
+   entry->fd        = file;
+   entry->off       = (unsigned long long) -1;
+   entry->addr      = (unsigned long long) (size_t) buffer;
+   entry->len       = (unsigned) length;
+   entry->user_data = tag;
+   ring->sq_array[index] = index;
+
+   /* The kernel may read the entry as soon as it sees the new tail                    */
+   __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   ring->queued++;
+
+   return;
+}
+
+/* Hands the queued transfers to the kernel, waiting for one to finish if asked        */
+int    enter_uring(URING *ring, int wait) {
+   long submitted; /* Holds the number of transfers the kernel took                    */
+
+   if (ring->queued == 0 && !wait) {
+      return 0;
+   }
+   do {
+      submitted = syscall(__NR_io_uring_enter, ring->file, ring->queued, wait ? 1 : 0,
+                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+   } while (submitted < 0 && errno == EINTR);
+   if (submitted < 0) {
+      return -1;
+   }
+   ring->queued -= (unsigned) submitted;
+
+   return 0;
+}
+
+/* Runs the pipeline on the calling thread with its transfers on an io_uring           */
+/* Chunks must be read and written in order, so one read and one write are in flight   */
+/* at a time. The thread only waits on the ring when it has no chunk to change.        */
+void   run_uring(PIPELINE *pipeline, URING *ring) {
+   struct io_uring_cqe *completion;  /* Points to the transfer that finished           */
+   size_t              sent    = 0,  /* Holds the characters of the oldest chunk sent  */
+                       slot;         /* Holds the buffer of a transfer                 */
+   unsigned            head;         /* Holds the next completion to collect           */
+   double              started;      /* Holds the clock when the wait started          */
+   int                 reading = 0,  /* Holds whether a read is in flight              */
+                       writing = 0,  /* Holds whether a write is in flight             */
+                       result;       /* Holds what a transfer gave                     */
+
+   while (pipeline->read_error == 0 && pipeline->write_error == 0) {
+
+      /* Read into the next free buffer and write the oldest changed chunk             */
+      if (!reading && !pipeline->ended &&
+          pipeline->filled - pipeline->written < PIPE_DEPTH) {
+         slot = pipeline->filled % PIPE_DEPTH;
+         queue_transfer(ring, IORING_OP_READ, pipeline->input,
+                        pipeline->buffers + slot * pipeline->chunk, pipeline->chunk,
+                        READ_TAG);
+         reading = 1;
+      }
+      if (!writing && pipeline->written < pipeline->changed) {
+         slot = pipeline->written % PIPE_DEPTH;
+         queue_transfer(ring, IORING_OP_WRITE, pipeline->output,
+                        pipeline->buffers + slot * pipeline->chunk + sent,
+                        pipeline->lengths[slot] - sent, WRITE_TAG);
+         writing = 1;
+      }
+      if (!reading && !writing && pipeline->changed == pipeline->filled) {
+         break;
+      }
+      /* Time spent waiting goes to the read when one is in flight, else the write     */
+      started = start_stage();
+      if (enter_uring(ring, pipeline->changed == pipeline->filled) != 0) {
+         pipeline->read_error = errno;
+         break;
+      }
+      stop_stage(reading ? READING : WRITING, started);
+
+      /* Collect whatever transfers have finished                                      */
+      head = *ring->cq_head;
+      while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+         completion = &ring->cqes[head & *ring->cq_mask];
+         result     = completion->res;
+         if (completion->user_data == READ_TAG) {
+            reading = 0;
+            if (result > 0) {
+               pipeline->lengths[pipeline->filled % PIPE_DEPTH] = (size_t) result;
+               pipeline->filled++;
+            } else if (result == 0) {
+               pipeline->ended = 1;
+            } else if (result != -EINTR) {
+               pipeline->read_error = -result;
+            }
+         } else {
+            writing = 0;
+            if (result >= 0) {
+               sent += (size_t) result;
+               if (sent == pipeline->lengths[pipeline->written % PIPE_DEPTH]) {
+                  pipeline->written++;
+                  sent = 0;
+               }
+            } else if (result != -EINTR) {
+               pipeline->write_error = -result;
+            }
+         }
+         head++;
+      }
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+      /* Change the oldest chunk read while the transfers run                          */
+      if (pipeline->changed < pipeline->filled) {
+         change_chunk(pipeline);
+         pipeline->changed++;
+      }
+   }
+
+   /* Let any transfer still in flight finish before its buffer is freed               */
+   while ((reading || writing) && enter_uring(ring, 1) == 0) {
+      head = *ring->cq_head;
+      while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+         if (ring->cqes[head & *ring->cq_mask].user_data == READ_TAG) {
+            reading = 0;
+         } else {
+            writing = 0;
+         }
+         head++;
+      }
+      __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+   }
+
+   return;
+}
+
+/* Takes down an io_uring                                                              */
+void   close_uring(URING *ring) {
+   if (ring->sqes != MAP_FAILED) {
+      munmap(ring->sqes, ring->sqes_size);
+   }
+   if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+      munmap(ring->cq_ring, ring->cq_size);
+   }
+   if (ring->sq_ring != MAP_FAILED) {
+      munmap(ring->sq_ring, ring->sq_size);
+   }
+   close(ring->file);
+
+   return;
+}
+#endif
+
+/* Finds the rotation or key of a ciphertext, reports it on stderr, and writes the     */
+/* text decrypted with it                                                              */
+int    crack_message(OPTIONS *options) {
+   CIPHER_SCORER *scorer = NULL;          /* Points to the quadgram table, or NULL     */
+   TEXT          *message;                /* Points to the chunk being read            */
+   FILE          *input  = stdin;         /* Points to the ciphertext                  */
+   int           output  = STDOUT_FILENO, /* Holds where the plaintext goes            */
+                 status;                  /* Holds the exit status of the program      */
+
+   /* Map the quadgram table first, since nothing can be done without it               */
+   if (options->quadgrams != NULL &&
+       (scorer = cipher_scorer_load(options->quadgrams)) == NULL) {
+      fprintf(stderr, "Failed to load %s: %s\n", options->quadgrams,
+              errno == EINVAL ? "not a quadgram table" : strerror(errno));
+      return 1;
+   }
+
+   /* Open the files named in place of stdin and stdout                                */
+   if (options->input_file != NULL &&
+       (input = fopen(options->input_file, "rb")) == NULL) {
+      fprintf(stderr, "Failed to open %s: %s\n", options->input_file, strerror(errno));
+      cipher_scorer_destroy(scorer);
+      return 1;
+   }
+   if (options->output_file != NULL &&
+       (output = open(options->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+      fprintf(stderr, "Failed to create %s: %s\n", options->output_file,
+              strerror(errno));
+      if (input != stdin) {
+         fclose(input);
+      }
+      cipher_scorer_destroy(scorer);
+      return 1;
+   }
+
+   message = create_string();
+   reserve_string(message, CHUNK_SIZE);
+   options->action = DECODE;
+   if (options->cipher == CAESAR) {
+      status = crack_caesar(options, input, output, message, scorer);
+   } else {
+      status = crack_vigenere(options, input, output, message, scorer);
+   }
+
+   /* Closing the output file is where a failed write can first show up                */
+   if (output != STDOUT_FILENO && close(output) != 0) {
+      fprintf(stderr, "Failed to write %s: %s\n", options->output_file, strerror(errno));
+      status = 1;
+   }
+   if (input != stdin) {
+      fclose(input);
+   }
+   clear_string(message);
+   cipher_scorer_destroy(scorer);
+
+   return status;
+}
+
+/* Finds the rotation of a caesar ciphertext from a single count of its letters, ranks */
+/* every rotation on stderr, and writes the text decrypted with the best one. Input    */
+/* that cannot be read twice is copied to a temporary file while it is counted. With a */
+/* quadgram table the rotations are ranked on the first chunk of the message instead,  */
+/* which tells them apart far sooner than single letters do.                           */
+int    crack_caesar(OPTIONS *options, FILE *input, int output, TEXT *message,
+                    const CIPHER_SCORER *scorer) {
+   unsigned long long counts[ALPHABET] = {0}; /* Holds the count of each letter        */
+   CIPHER_GUESS       guesses[ALPHABET];      /* Holds every rotation, best first      */
+   CIPHER_STREAM      *stream;                /* Holds the position in the key         */
+   TEXT               *sample;                /* Points to the start of the message    */
+   FILE               *spool = NULL;          /* Points to the copy of the ciphertext  */
+   off_t              start;                  /* Holds where the ciphertext starts     */
+   size_t             taken;                  /* Holds the characters added to sample  */
+   double             started;                /* Holds when the stage started          */
+   int                status = 0,             /* Holds the exit status of the program  */
+                      index;                  /* Holds the rotation being printed      */
+
+   if ((start = ftello(input)) < 0 && (spool = tmpfile()) == NULL) {
+      fprintf(stderr, "Failed to create a temporary file: %s\n", strerror(errno));
+      return 1;
+   }
+   sample = create_string();
+   reserve_string(sample, CHUNK_SIZE);
+
+   /* Count the letters, keeping a copy when the input cannot be read again            */
+   started = start_stage();
+   while (status == 0 &&
+          (message->length =
+              fread(message->characters, 1, message->capacity, input)) > 0) {
+      stop_stage(READING, started);
+      started = start_stage();
+      cipher_count_frequencies(message->characters, message->length, counts);
+      stop_stage(SEARCHING, started);
+      taken = CHUNK_SIZE - sample->length < message->length
+                 ? CHUNK_SIZE - sample->length : message->length;
+      memcpy(sample->characters + sample->length, message->characters, taken);
+      sample->length += taken;
+      if (spool != NULL &&
+          fwrite(message->characters, 1, message->length, spool) != message->length) {
+         fprintf(stderr, "Failed to write a temporary file: %s\n", strerror(errno));
+         status = 1;
+      }
+      started = start_stage();
+   }
+   stop_stage(READING, started);
+   if (ferror(input)) {
+      fprintf(stderr, "Failed to read the message.\n");
+      status = 1;
+   }
+
+   /* Rank the rotations and decrypt the ciphertext again with the best of them        */
+   if (status == 0) {
+      started = start_stage();
+      if (scorer != NULL) {
+         cipher_score_rotations(scorer, sample->characters, sample->length, guesses);
+      } else {
+         cipher_rank_rotations(counts, guesses);
+      }
+      stop_stage(SEARCHING, started);
+      fprintf(stderr, scorer != NULL ? "Rotation    Quadgrams\n"
+                                     : "Rotation  Chi-squared\n");
+      for (index = 0; index < ALPHABET; index++) {
+         fprintf(stderr, "%8d  %11.2f\n", guesses[index].rotation, guesses[index].score);
+      }
+
+      if ((options->context = cipher_create_caesar(guesses[0].rotation)) == NULL) {
+         fprintf(stderr, "Failed to allocate the cipher.\n");
+         status = 1;
+      } else if (spool != NULL ? fseeko(spool, 0, SEEK_SET) != 0
+                               : fseeko(input, start, SEEK_SET) != 0) {
+         fprintf(stderr, "Failed to read the message again: %s\n", strerror(errno));
+         status = 1;
+      }
+   }
+   if (status == 0) {
+      options->threads = cipher_set_threads(options->context, options->threads);
+      stream = create_stream(options);
+      status = pump_stream(spool != NULL ? spool : input, output, stream, message);
+      cipher_stream_destroy(stream);
+   }
+
+   if (spool != NULL) {
+      fclose(spool);
+   }
+   clear_string(sample);
+
+   return status;
+}
+
+/* Finds the key of a vigenere ciphertext from the letters at its start, reports it on */
+/* stderr, and writes the text decrypted with it. Only the sample is held in memory;   */
+/* the rest of the message streams straight through once the key is known. With a      */
+/* quadgram table the key found is then hill-climbed on the sample before it is used.  */
+int    crack_vigenere(OPTIONS *options, FILE *input, int output, TEXT *message,
+                      const CIPHER_SCORER *scorer) {
+   unsigned long long counts[ALPHABET] = {0}; /* Holds the count of each letter        */
+   CIPHER_STREAM      *stream;                /* Holds the position in the key         */
+   TEXT               *key;                   /* Points to the key found               */
+   size_t             letters = 0,            /* Holds the letters read so far         */
+                      read;                   /* Holds the characters one read gave    */
+   double             started;                /* Holds when the stage started          */
+   int                letter,                 /* Holds the letter being added up       */
+                      status = 0;             /* Holds the exit status of the program  */
+
+   /* Read until the sample is full or the message ends                                */
+   message->length = 0;
+   while (letters < options->sample) {
+      reserve_string(message, message->length + CHUNK_SIZE);
+      started = start_stage();
+      read    = fread(message->characters + message->length, 1, CHUNK_SIZE, input);
+      stop_stage(READING, started);
+      if (read == 0) {
+         break;
+      }
+      cipher_count_frequencies(message->characters + message->length, read, counts);
+      message->length += read;
+      for (letters = 0, letter = 0; letter < ALPHABET; letter++) {
+         letters += counts[letter];
+      }
+   }
+   if (ferror(input)) {
+      fprintf(stderr, "Failed to read the message.\n");
+      return 1;
+   }
+
+   /* Find the key and report it                                                       */
+   key = create_string();
+   reserve_string(key, options->longest);
+   started     = start_stage();
+   key->length = cipher_recover_key(message->characters, message->length,
+                                    options->longest, options->sample,
+                                    options->threads, key->characters);
+   stop_stage(SEARCHING, started);
+   if (key->length == 0) {
+      fprintf(stderr, errno == EINVAL ? "Too few letters to find a key.\n"
+                                      : "Failed to allocate the key search.\n");
+      clear_string(key);
+      return 1;
+   }
+   started = start_stage();
+   if (scorer != NULL &&
+       cipher_refine_key(scorer, message->characters, message->length, options->sample,
+                         key->characters) != 0) {
+      fprintf(stderr, "Failed to allocate the key search.\n");
+      clear_string(key);
+      return 1;
+   }
+   stop_stage(SEARCHING, started);
+   fprintf(stderr, "Key: %s\n", key->characters);
+
+   /* Decrypt the sample, then the rest of the message as it arrives                   */
+   options->context = cipher_create_vigenere(key->characters, key->length);
+   if (options->context == NULL) {
+      fprintf(stderr, "Failed to allocate the cipher.\n");
+      status = 1;
+   } else {
+      options->threads = cipher_set_threads(options->context, options->threads);
+      stream  = create_stream(options);
+      started = start_stage();
+      cipher_stream_update(stream, message->characters, message->characters,
+                           message->length);
+      stop_stage(CIPHERING, started);
+      count_characters(message->characters, message->length);
+      if (!write_all(output, message->characters, message->length)) {
+         fprintf(stderr, "Failed to write the message: %s\n", strerror(errno));
+         status = 1;
+      } else {
+         status = pump_stream(input, output, stream, message);
+      }
+      cipher_stream_destroy(stream);
+   }
+   clear_string(key);
+
+   return status;
+}
+
+/* Builds a quadgram table from a corpus of English text and saves it                  */
+/* The corpus is read whole, from the input file or stdin, and counted in one pass.    */
+int    train_quadgrams(OPTIONS *options) {
+   CIPHER_SCORER *scorer;        /* Points to the table built from the corpus          */
+   TEXT          *corpus;        /* Points to the whole corpus                         */
+   FILE          *input = stdin; /* Points to the corpus file                          */
+   size_t        read;           /* Holds the characters one read gave                 */
+   int           status = 0;     /* Holds the exit status of the program               */
+
+   if (options->input_file != NULL &&
+       (input = fopen(options->input_file, "rb")) == NULL) {
+      fprintf(stderr, "Failed to open %s: %s\n", options->input_file, strerror(errno));
+      return 1;
+   }
+
+   /* Read the corpus a chunk at a time into one buffer                                */
+   corpus = create_string();
+   do {
+      reserve_string(corpus, corpus->length + CHUNK_SIZE);
+      read            = fread(corpus->characters + corpus->length, 1, CHUNK_SIZE, input);
+      corpus->length += read;
+   } while (read > 0);
+   if (ferror(input)) {
+      fprintf(stderr, "Failed to read the corpus.\n");
+      status = 1;
+   }
+   if (input != stdin) {
+      fclose(input);
+   }
+
+   /* Count its quadgrams and write the table                                          */
+   if (status == 0) {
+      if ((scorer = cipher_scorer_train(corpus->characters, corpus->length)) == NULL) {
+         fprintf(stderr, errno == EINVAL ? "The corpus needs at least four letters.\n"
+                                         : "Failed to allocate the quadgram table.\n");
+         status = 1;
+      } else {
+         if (cipher_scorer_save(scorer, options->quadgrams) != 0) {
+            fprintf(stderr, "Failed to write %s: %s\n", options->quadgrams,
+                    strerror(errno));
+            status = 1;
+         }
+         cipher_scorer_destroy(scorer);
+      }
+   }
+   clear_string(corpus);
+
+   return status;
+}
+
+/* Applies the chosen cipher to a file through memory maps, in place or into another   */
+/* file. The files are mapped a window at a time so memory use stays the same however  */
+/* large they are.                                                                     */
+int    cipher_file(OPTIONS *options) {
+   struct stat   input_status,     /* Holds the size and identity of the input file    */
+                 output_status;    /* Holds the identity of the output file            */
+   int           input_file,       /* Holds the descriptor of the input file           */
+                 output_file = -1, /* Holds the descriptor of the output file          */
+                 in_place,         /* Holds whether the input file is changed itself   */
+                 status      = 0;  /* Holds the exit status of the program             */
+   off_t         offset;           /* Holds the place of the window in the files       */
+   size_t        length;           /* Holds the number of characters in the window     */
+   char          *input,           /* Points to the window of the input file           */
+                 *output;          /* Points to the window of the output file          */
+   CIPHER_STREAM *stream;          /* Holds the position in the key across windows     */
+   double        started;          /* Holds the clock at the start of a stage          */
+
+   /* Writing over the input file is the same as changing it in place                  */
+   in_place = options->output_file == NULL ||
+              (stat(options->output_file, &output_status) == 0 &&
+               stat(options->input_file, &input_status) == 0 &&
+               output_status.st_dev == input_status.st_dev &&
+               output_status.st_ino == input_status.st_ino);
+
+   /* Open the files and make the output file as large as the input file               */
+   if ((input_file = open(options->input_file, in_place ? O_RDWR : O_RDONLY)) < 0 ||
+       fstat(input_file, &input_status) != 0) {
+      fprintf(stderr, "Failed to open %s: %s\n", options->input_file, strerror(errno));
+      if (input_file >= 0) {
+         close(input_file);
+      }
+      return 1;
+   }
+
+   /* Only a regular file has a size to map by; a pipe or device would give nothing    */
+   if (!S_ISREG(input_status.st_mode)) {
+      fprintf(stderr, "%s is not a regular file; pass it on stdin instead.\n",
+              options->input_file);
+      close(input_file);
+      return 1;
+   }
+   if (!in_place &&
+       ((output_file = open(options->output_file, O_RDWR | O_CREAT | O_TRUNC,
+                            input_status.st_mode & 0777)) < 0 ||
+        ftruncate(output_file, input_status.st_size) != 0)) {
+      fprintf(stderr, "Failed to create %s: %s\n", options->output_file,
+              strerror(errno));
+      close(input_file);
+      if (output_file >= 0) {
+         close(output_file);
+      }
+      return 1;
+   }
+
+   /* Map each window of the files in turn and change it                               */
+   stream = create_stream(options);
+   for (offset = 0; offset < input_status.st_size; offset += MAP_WINDOW) {
+      length  = input_status.st_size - offset < MAP_WINDOW
+                   ? (size_t) (input_status.st_size - offset) : MAP_WINDOW;
+      started = start_stage();
+      input   = mmap(NULL, length, in_place ? PROT_READ | PROT_WRITE : PROT_READ,
+                     MAP_SHARED, input_file, offset);
+      if (input == MAP_FAILED) {
+         fprintf(stderr, "Failed to map %s: %s\n", options->input_file, strerror(errno));
+         status = 1;
+         break;
+      }
+      madvise(input, length, MADV_SEQUENTIAL);
+      output = input;
+      if (!in_place) {
+         output = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       output_file, offset);
+         if (output == MAP_FAILED) {
+            fprintf(stderr, "Failed to map %s: %s\n", options->output_file,
+                    strerror(errno));
+            munmap(input, length);
+            status = 1;
+            break;
+         }
+         madvise(output, length, MADV_SEQUENTIAL);
+      }
+      stop_stage(READING, started);
+
+      /* Page faults on the mapped windows land in this stage too                      */
+      started = start_stage();
+      cipher_stream_update(stream, input, output, length);
+      stop_stage(CIPHERING, started);
+      count_characters(output, length);
+
+      /* Unmapping hands the written pages to the system so they leave the program     */
+      started = start_stage();
+      if (!in_place) {
+         munmap(output, length);
+      }
+      munmap(input, length);
+      stop_stage(WRITING, started);
+   }
+
+   /* Closing the output file is where a failed write can first show up                */
+   cipher_stream_destroy(stream);
+   close(input_file);
+   if (output_file >= 0 && close(output_file) != 0) {
+      fprintf(stderr, "Failed to write %s: %s\n", options->output_file, strerror(errno));
+      status = 1;
+   }
+
+   return status;
+}
+
+/* Gives whether a path names a directory                                              */
+int    is_directory(const char *path) {
+   struct stat status; /* Holds the type of the file                                   */
+
+   return stat(path, &status) == 0 && S_ISDIR(status.st_mode);
+}
+
+/* Applies the chosen cipher to every file under a directory on a pool of threads      */
+/* Each file is a message of its own, starting from the start of the key. Directories  */
+/* and files become tasks as they are found, large files are split into pieces, and a  */
+/* thread that runs out of tasks steals from the others, so a few huge files among     */
+/* thousands of tiny ones still keep every thread busy.                                */
+int    cipher_tree(OPTIONS *options) {
+   POOL        pool;    /* Holds the threads and what they share                       */
+   struct stat input,   /* Holds the identity of the input directory                   */
+               output;  /* Holds the identity of the output directory                  */
+   int         index;   /* Holds the thread being started or joined                    */
+   double      started; /* Holds the clock when the run started                        */
+
+   /* Changing the directory over itself is the same as changing it in place           */
+   pool.in_place = options->in_place ||
+                   (stat(options->output_file, &output) == 0 &&
+                    stat(options->input_file, &input) == 0 &&
+                    output.st_dev == input.st_dev && output.st_ino == input.st_ino);
+   if (!pool.in_place &&
+       ((mkdir(options->output_file, 0777) != 0 && errno != EEXIST) ||
+        stat(options->output_file, &output) != 0 || !S_ISDIR(output.st_mode))) {
+      fprintf(stderr, "Failed to create %s: %s\n", options->output_file,
+              errno == EEXIST ? strerror(ENOTDIR) : strerror(errno));
+      return 1;
+   }
+
+   /* Each task is changed on one thread; the threads come from the pool instead       */
+   pool.options = options;
+   pool.count   = options->threads;
+   pool.failed  = 0;
+   pool.pending = 0;
+   pool.queued  = 0;
+   pool.device  = pool.in_place ? 0 : output.st_dev;
+   pool.inode   = pool.in_place ? 0 : output.st_ino;
+   cipher_set_threads(options->context, 1);
+   pthread_mutex_init(&pool.lock, NULL);
+   pthread_cond_init(&pool.wake, NULL);
+   if ((pool.workers = (WORKER *) calloc(pool.count, sizeof(WORKER))) == NULL) {
+      fprintf(stderr, "Failed to allocate the threads.\n");
+      exit(1);
+   }
+   for (index = 0; index < pool.count; index++) {
+      pool.workers[index].pool = &pool;
+      pool.workers[index].buffer = create_string();
+      reserve_string(pool.workers[index].buffer, TREE_SPLIT);
+      pthread_mutex_init(&pool.workers[index].lock, NULL);
+   }
+
+   /* Start from the top directory and let the threads take it from there              */
+   started = start_stage();
+   push_task(&pool.workers[0], WALK_TASK,
+             join_path(options->input_file, NULL),
+             join_path(pool.in_place ? options->input_file : options->output_file, NULL),
+             NULL, 0);
+   for (index = 1; index < pool.count; index++) {
+      if (pthread_create(&pool.workers[index].thread, NULL, run_worker,
+                         &pool.workers[index]) != 0) {
+         break;
+      }
+   }
+   run_worker(&pool.workers[0]);
+   while (--index > 0) {
+      pthread_join(pool.workers[index].thread, NULL);
+   }
+   stop_stage(CIPHERING, started);
+
+   for (index = 0; index < pool.count; index++) {
+      if (stats.enabled) {
+         stats.characters += pool.workers[index].characters;
+         stats.letters    += pool.workers[index].letters;
+      }
+      clear_string(pool.workers[index].buffer);
+      free(pool.workers[index].tasks);
+      pthread_mutex_destroy(&pool.workers[index].lock);
+   }
+   free(pool.workers);
+   pthread_cond_destroy(&pool.wake);
+   pthread_mutex_destroy(&pool.lock);
+
+   return pool.failed;
+}
+
+/* Runs tasks, its own or stolen, until every task of the pool is finished             */
+void   *run_worker(void *argument) {
+   WORKER *worker = (WORKER *) argument; /* Points to the thread's tasks               */
+   POOL   *pool   = worker->pool;        /* Points to the pool it belongs to           */
+   TASK   *task;                         /* Points to the task being run               */
+   int    finished;                      /* Holds whether every task is finished       */
+
+   for (;;) {
+
+      /* With nothing to take, sleep until a task is added or all are finished         */
+      if ((task = take_task(worker)) == NULL) {
+         pthread_mutex_lock(&pool->lock);
+         while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 &&
+                __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) != 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+         }
+         finished = __atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) == 0;
+         pthread_mutex_unlock(&pool->lock);
+         if (finished) {
+            break;
+         }
+         continue;
+      }
+
+      if (task->kind == WALK_TASK) {
+         walk_directory(worker, task);
+      } else if (task->kind == FILE_TASK) {
+         change_file(worker, task);
+      } else if (task->kind == COUNT_TASK) {
+         count_piece(worker, task);
+      } else {
+         change_piece(worker, task);
+      }
+      free(task->input);
+      free(task->output);
+      free(task);
+
+      /* The tasks a task adds are counted before it finishes, so this reaches 0 once  */
+      if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+         pthread_mutex_lock(&pool->lock);
+         pthread_cond_broadcast(&pool->wake);
+         pthread_mutex_unlock(&pool->lock);
+      }
+   }
+
+   return NULL;
+}
+
+/* Adds a task to the bottom of a thread's tasks and wakes a thread to take it         */
+void   push_task(WORKER *worker, char kind, char *input, char *output, JOB *job,
+                 size_t piece) {
+   POOL *pool = worker->pool; /* Points to the pool the thread belongs to              */
+   TASK *task;                /* Points to the new task                                */
+
+   if ((task = (TASK *) malloc(sizeof(TASK))) == NULL) {
+      fprintf(stderr, "Failed to allocate a task.\n");
+      exit(1);
+   }
+   task->kind   = kind;
+   task->input  = input;
+   task->output = output;
+   task->job    = job;
+   task->piece  = piece;
+   __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+
+   /* Slide the waiting tasks down before growing the room for them                    */
+   pthread_mutex_lock(&worker->lock);
+   if (worker->bottom == worker->capacity && worker->top > 0) {
+      memmove(worker->tasks, worker->tasks + worker->top,
+              (worker->bottom - worker->top) * sizeof(TASK *));
+      worker->bottom -= worker->top;
+      worker->top     = 0;
+   }
+   if (worker->bottom == worker->capacity) {
+      worker->capacity = worker->capacity == 0 ? START_SIZE : worker->capacity * 2;
+      worker->tasks = (TASK **) realloc(worker->tasks,
+                                        worker->capacity * sizeof(TASK *));
+      if (worker->tasks == NULL) {
+         fprintf(stderr, "Failed to allocate a task.\n");
+         exit(1);
+      }
+   }
+   worker->tasks[worker->bottom++] = task;
+   pthread_mutex_unlock(&worker->lock);
+
+   /* Counting the task before taking the lock means a sleeper cannot miss it          */
+   __atomic_add_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+   pthread_mutex_lock(&pool->lock);
+   pthread_cond_signal(&pool->wake);
+   pthread_mutex_unlock(&pool->lock);
+
+   return;
+}
+
+/* Takes a thread's newest task, or steals another thread's oldest, or gives NULL      */
+TASK   *take_task(WORKER *worker) {
+   POOL   *pool   = worker->pool;                /* Points to the pool of threads      */
+   WORKER *victim = worker;                      /* Points to the thread taken from    */
+   TASK   *task   = NULL;                        /* Points to the task taken           */
+   int    index,                                 /* Holds the thread tried next        */
+          self    = (int) (worker - pool->workers); /* Holds the place of the thread   */
+
+   for (index = 0; index < pool->count && task == NULL; index++) {
+      victim = &pool->workers[(self + index) % pool->count];
+      pthread_mutex_lock(&victim->lock);
+      if (victim->bottom > victim->top) {
+         task = victim == worker ? victim->tasks[--victim->bottom]
+                                 : victim->tasks[victim->top++];
+      }
+      pthread_mutex_unlock(&victim->lock);
+   }
+   if (task != NULL) {
+      __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_ACQ_REL);
+   }
+
+   return task;
+}
+
+/* Creates the output directory of a directory and adds a task for each entry          */
+void   walk_directory(WORKER *worker, TASK *task) {
+   POOL          *pool = worker->pool; /* Points to the pool of threads                */
+   DIR           *directory;           /* Holds the directory being listed             */
+   struct dirent *entry;               /* Points to the entry being added              */
+   struct stat   status;               /* Holds the type of the entry                  */
+   char          *input,               /* Points to the path of the entry              */
+                 *output;              /* Points to the path it is written to          */
+
+   if (!pool->in_place && mkdir(task->output, 0777) != 0 && errno != EEXIST) {
+      report_failure(pool, "create", task->output);
+      return;
+   }
+   if ((directory = opendir(task->input)) == NULL) {
+      report_failure(pool, "open", task->input);
+      return;
+   }
+
+   /* Directories and regular files are followed; links and the like are left alone    */
+   while ((entry = readdir(directory)) != NULL) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+      input = join_path(task->input, entry->d_name);
+      if (lstat(input, &status) != 0) {
+         report_failure(pool, "read", input);
+         free(input);
+         continue;
+      }
+
+      /* An output directory inside the input one is not copied into itself            */
+      if ((!S_ISDIR(status.st_mode) && !S_ISREG(status.st_mode)) ||
+          (!pool->in_place && status.st_dev == pool->device &&
+           status.st_ino == pool->inode)) {
+         free(input);
+         continue;
+      }
+      output = join_path(task->output, entry->d_name);
+      push_task(worker, S_ISDIR(status.st_mode) ? WALK_TASK : FILE_TASK, input, output,
+                NULL, 0);
+   }
+   closedir(directory);
+
+   return;
+}
+
+/* Changes a small file with one read and one write, or splits a large one into pieces */
+void   change_file(WORKER *worker, TASK *task) {
+   POOL        *pool = worker->pool; /* Points to the pool of threads                  */
+   struct stat status;               /* Holds the size and mode of the file            */
+   JOB         *job;                 /* Points to the file when it is split            */
+   char        *characters = worker->buffer->characters;
+                                     /* Points to the buffer the file is read into     */
+   ssize_t     length;               /* Holds the characters one read gave             */
+   size_t      total = 0,            /* Holds the characters read so far               */
+               piece;                /* Holds the piece being added                    */
+   int         input,                /* Holds the descriptor of the file read          */
+               output;               /* Holds the descriptor of the file written       */
+
+   if ((input = open(task->input, pool->in_place ? O_RDWR : O_RDONLY)) < 0 ||
+       fstat(input, &status) != 0) {
+      report_failure(pool, "open", task->input);
+      if (input >= 0) {
+         close(input);
+      }
+      return;
+   }
+   output = input;
+   if (!pool->in_place &&
+       (output = open(task->output, (status.st_size > TREE_SPLIT ? O_RDWR : O_WRONLY) |
+                      O_CREAT | O_TRUNC, status.st_mode & 0777)) < 0) {
+      report_failure(pool, "create", task->output);
+      close(input);
+      return;
+   }
+
+   /* A small file is read, changed and written whole                                  */
+   if (status.st_size <= TREE_SPLIT) {
+      do {
+         length = read(input, characters + total, TREE_SPLIT - total);
+         total += length > 0 ? (size_t) length : 0;
+      } while ((length > 0 && total < (size_t) status.st_size) ||
+               (length < 0 && errno == EINTR));
+      if (length < 0) {
+         report_failure(pool, "read", task->input);
+      } else {
+         apply_action(pool, 0, characters, characters, total, worker);
+         if ((pool->in_place && lseek(output, 0, SEEK_SET) != 0) ||
+             !write_all(output, characters, total)) {
+            report_failure(pool, "write", task->output);
+         }
+      }
+      if (output != input && close(output) != 0) {
+         report_failure(pool, "write", task->output);
+      }
+      close(input);
+      return;
+   }
+
+   /* A large file is split, and its pieces counted first when the key has a position  */
+   if (!pool->in_place && ftruncate(output, status.st_size) != 0) {
+      report_failure(pool, "create", task->output);
+      close(output);
+      close(input);
+      return;
+   }
+   if ((job = (JOB *) malloc(sizeof(JOB))) == NULL) {
+      fprintf(stderr, "Failed to allocate a job.\n");
+      exit(1);
+   }
+   job->input       = task->input;
+   job->output      = task->output;
+   job->input_file  = input;
+   job->output_file = output;
+   job->failed      = 0;
+   job->size        = (size_t) status.st_size;
+   job->pieces      = (job->size + TREE_CHUNK - 1) / TREE_CHUNK;
+   job->remaining   = job->pieces;
+   if ((job->positions = (size_t *) calloc(job->pieces, sizeof(size_t))) == NULL) {
+      fprintf(stderr, "Failed to allocate a job.\n");
+      exit(1);
+   }
+   task->input  = NULL;
+   task->output = NULL;
+   for (piece = 0; piece < job->pieces; piece++) {
+      push_task(worker, pool->options->cipher == VIGENERE ? COUNT_TASK : PIECE_TASK,
+                NULL, NULL, job, piece);
+   }
+
+   return;
+}
+
+/* Counts the letters of a piece, and once every piece is counted, queues the changes  */
+void   count_piece(WORKER *worker, TASK *task) {
+   JOB                *job = task->job;        /* Points to the file being split       */
+   unsigned long long counts[ALPHABET] = {0};  /* Holds the count of each letter       */
+   size_t             offset = task->piece * TREE_CHUNK,
+                                               /* Holds where the piece starts         */
+                      length,                  /* Holds the characters in the piece    */
+                      letters,                 /* Holds the letters before a piece     */
+                      count,                   /* Holds the letters in a piece         */
+                      piece;                   /* Holds the piece being added up       */
+   char               *input;                  /* Points to the mapped piece           */
+   int                letter;                  /* Holds the letter being added up      */
+
+   length = job->size - offset < TREE_CHUNK ? job->size - offset : TREE_CHUNK;
+   input  = mmap(NULL, length, PROT_READ, MAP_SHARED, job->input_file, (off_t) offset);
+   if (input == MAP_FAILED) {
+      report_failure(worker->pool, "map", job->input);
+      __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+   } else {
+      cipher_count_frequencies(input, length, counts);
+      munmap(input, length);
+      for (letter = 0; letter < ALPHABET; letter++) {
+         job->positions[task->piece] += counts[letter];
+      }
+   }
+   if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) != 0) {
+      return;
+   }
+
+   /* The last piece counted turns the counts into where each piece starts. Pieces     */
+   /* mark a failure atomically, and the count of those left orders it before here.    */
+   if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+      finish_job(worker->pool, job);
+      return;
+   }
+   for (piece = 0, letters = 0; piece < job->pieces; piece++) {
+      count                 = job->positions[piece];
+      job->positions[piece] = letters;
+      letters              += count;
+   }
+   job->remaining = job->pieces;
+   for (piece = 0; piece < job->pieces; piece++) {
+      push_task(worker, PIECE_TASK, NULL, NULL, job, piece);
+   }
+
+   return;
+}
+
+/* Changes a piece from its place in the key, and closes the file after the last one   */
+void   change_piece(WORKER *worker, TASK *task) {
+   POOL   *pool = worker->pool;            /* Points to the pool of threads            */
+   JOB    *job  = task->job;               /* Points to the file being split           */
+   size_t offset = task->piece * TREE_CHUNK, /* Holds where the piece starts           */
+          length;                          /* Holds the characters in the piece        */
+   char   *input,                          /* Points to the mapped piece read          */
+          *output;                         /* Points to the mapped piece written       */
+
+   length = job->size - offset < TREE_CHUNK ? job->size - offset : TREE_CHUNK;
+   input  = mmap(NULL, length, pool->in_place ? PROT_READ | PROT_WRITE : PROT_READ,
+                 MAP_SHARED, job->input_file, (off_t) offset);
+   output = input;
+   if (input != MAP_FAILED && !pool->in_place) {
+      output = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, job->output_file,
+                    (off_t) offset);
+   }
+   if (input == MAP_FAILED || output == MAP_FAILED) {
+      report_failure(pool, "map", input == MAP_FAILED ? job->input : job->output);
+      __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+   } else {
+      apply_action(pool, job->positions[task->piece], input, output, length, worker);
+   }
+   if (output != MAP_FAILED && output != input) {
+      munmap(output, length);
+   }
+   if (input != MAP_FAILED) {
+      munmap(input, length);
+   }
+
+   if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+      finish_job(pool, job);
+   }
+
+   return;
+}
+
+/* Applies the chosen cipher to characters starting at a place in the key              */
+void   apply_action(POOL *pool, size_t position, const char *input, char *output,
+                    size_t length, WORKER *worker) {
+   unsigned long long counts[ALPHABET] = {0}; /* Holds the count of each letter        */
+   int                letter;                 /* Holds the letter being added up       */
+
+   if (pool->options->action == ENCODE) {
+      cipher_encrypt_from(pool->options->context, position, input, output, length);
+   } else {
+      cipher_decrypt_from(pool->options->context, position, input, output, length);
+   }
+
+   /* Each thread counts for itself, and the counts are added up at the end            */
+   if (stats.enabled) {
+      cipher_count_frequencies(output, length, counts);
+      for (letter = 0; letter < ALPHABET; letter++) {
+         worker->letters += counts[letter];
+      }
+      worker->characters += length;
+   }
+
+   return;
+}
+
+/* Closes the files of a split file and frees it                                       */
+void   finish_job(POOL *pool, JOB *job) {
+   if (job->output_file != job->input_file && close(job->output_file) != 0) {
+      report_failure(pool, "write", job->output);
+   }
+   close(job->input_file);
+   free(job->positions);
+   free(job->input);
+   free(job->output);
+   free(job);
+
+   return;
+}
+
+/* Makes a path from a directory and the name of an entry in it, or copies the         */
+/* directory's path alone when there is no name                                        */
+char   *join_path(const char *directory, const char *name) {
+   size_t length = strlen(directory); /* Holds the characters in the directory's path  */
+   char   *path;                      /* Points to the path made                       */
+
+   if ((path = (char *) malloc(length + (name ? strlen(name) : 0) + 2)) == NULL) {
+      fprintf(stderr, "Failed to allocate a path.\n");
+      exit(1);
+   }
+   strcpy(path, directory);
+   if (name != NULL) {
+      if (length == 0 || path[length - 1] != '/') {
+         path[length++] = '/';
+      }
+      strcpy(path + length, name);
+   }
+
+   return path;
+}
+
+/* Reports a file that could not be changed and marks the run as failed                */
+void   report_failure(POOL *pool, const char *doing, const char *path) {
+   fprintf(stderr, "Failed to %s %s: %s\n", doing, path, strerror(errno));
+   __atomic_store_n(&pool->failed, 1, __ATOMIC_RELAXED);
+
+   return;
+}
+
+/* Answers requests on a Unix domain socket until it is told to stop                   */
+/* One thread waits on every connection with epoll and reads whole requests, which a   */
+/* pool of workers answers in place. The ciphers of recent keys are kept ready in the  */
+/* cache, so a request with a key seen before costs no more than changing its payload. */
+#ifdef LINUX_EPOLL
+int    serve_requests(OPTIONS *options) {
+   SERVER             server;             /* Holds the server and what it shares       */
+   struct epoll_event events[SERVE_WAIT], /* Holds the events waited for               */
+                      event;              /* Holds the event of a new descriptor       */
+   struct sigaction   handler;            /* Holds what a signal to stop does          */
+   sigset_t           signals;            /* Holds the signals the workers ignore      */
+   CONNECTION         *connection,        /* Points to the connection with an event    */
+                      *answered;          /* Points to the connections answered        */
+   unsigned long long woken;              /* Holds what the event descriptor held      */
+   int                ready,              /* Holds the number of events waited for     */
+                      index,              /* Holds the event or worker being handled   */
+                      wakeup,             /* Holds whether the workers answered any    */
+                      status = 0;         /* Holds the exit status of the program      */
+
+   memset(&server, 0, sizeof(server));
+   server.options        = options;
+   server.cache.capacity = options->cache_size;
+   for (server.cache.mask = 1; server.cache.mask < options->cache_size * 2;
+        server.cache.mask *= 2) {
+   }
+   server.cache.buckets = (ENTRY **) calloc(server.cache.mask, sizeof(ENTRY *));
+   if (server.cache.buckets == NULL) {
+      fprintf(stderr, "Failed to allocate the cache.\n");
+      exit(1);
+   }
+   server.cache.mask--;
+   pthread_mutex_init(&server.cache.lock, NULL);
+   pthread_mutex_init(&server.lock, NULL);
+   pthread_cond_init(&server.work, NULL);
+
+   /* Listen, and wait on the socket and on the workers' event descriptor              */
+   server.events = -1;
+   server.wakeup = -1;
+   if ((server.listener = open_listener(options->socket_path)) < 0 ||
+       (server.events = epoll_create1(0)) < 0 ||
+       (server.wakeup = eventfd(0, EFD_NONBLOCK)) < 0) {
+      fprintf(stderr, "Failed to listen on %s: %s\n", options->socket_path,
+              strerror(errno));
+      status = 1;
+   }
+   if (status == 0) {
+      event.events   = EPOLLIN;
+      event.data.ptr = NULL;
+      epoll_ctl(server.events, EPOLL_CTL_ADD, server.listener, &event);
+      event.data.ptr = &server.wakeup;
+      epoll_ctl(server.events, EPOLL_CTL_ADD, server.wakeup, &event);
+
+      /* The workers each change one payload at a time on their own, and leave the     */
+      /* signals to stop to this thread, whose wait they interrupt                     */
+      memset(&handler, 0, sizeof(handler));
+      handler.sa_handler = stop_serving;
+      sigemptyset(&handler.sa_mask);
+      sigaction(SIGINT, &handler, NULL);
+      sigaction(SIGTERM, &handler, NULL);
+      sigemptyset(&signals);
+      sigaddset(&signals, SIGINT);
+      sigaddset(&signals, SIGTERM);
+      pthread_sigmask(SIG_BLOCK, &signals, NULL);
+      server.count = options->threads > 0 ? options->threads
+                                          : (int) sysconf(_SC_NPROCESSORS_ONLN);
+      server.count = server.count < 1 ? 1
+                   : server.count > CIPHER_MAX_THREADS ? CIPHER_MAX_THREADS
+                   : server.count;
+      for (index = 0; index < server.count; index++) {
+         if (pthread_create(&server.workers[index], NULL, serve_worker, &server) != 0) {
+            break;
+         }
+      }
+      server.count = index;
+      pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+      if (server.count == 0) {
+         fprintf(stderr, "Failed to start the workers.\n");
+         status = 1;
+      }
+   }
+   if (status == 0) {
+      fprintf(stderr, "Serving on %s with %d workers.\n", options->socket_path,
+              server.count);
+   }
+
+   while (status == 0 && !stop_requested) {
+      if ((ready = epoll_wait(server.events, events, SERVE_WAIT, -1)) < 0) {
+         if (errno != EINTR) {
+            fprintf(stderr, "Failed to wait on %s: %s\n", options->socket_path,
+                    strerror(errno));
+            status = 1;
+         }
+         continue;
+      }
+
+      /* Answered connections are sent last, as sending may close one                  */
+      /* whose events are still to be handled                                          */
+      wakeup = 0;
+      for (index = 0; index < ready; index++) {
+         connection = (CONNECTION *) events[index].data.ptr;
+         if (connection == NULL) {
+            accept_connections(&server);
+         } else if (events[index].data.ptr == &server.wakeup) {
+            wakeup = 1;
+         } else if (connection->busy) {
+            if (events[index].events & (EPOLLHUP | EPOLLERR)) {
+               connection->closing = 1;
+            }
+         } else if (connection->size > 0) {
+            send_reply(&server, connection);
+         } else {
+            read_requests(&server, connection);
+         }
+      }
+      if (wakeup) {
+         while (read(server.wakeup, &woken, sizeof(woken)) > 0) {
+         }
+         pthread_mutex_lock(&server.lock);
+         answered        = server.answered;
+         server.answered = NULL;
+         pthread_mutex_unlock(&server.lock);
+         while (answered != NULL) {
+            connection       = answered;
+            answered         = answered->next;
+            connection->busy = 0;
+            if (connection->closing) {
+               close_connection(&server, connection);
+            } else {
+               event.events   = EPOLLIN | EPOLLRDHUP;
+               event.data.ptr = connection;
+               epoll_ctl(server.events, EPOLL_CTL_ADD, connection->file, &event);
+               send_reply(&server, connection);
+            }
+         }
+      }
+   }
+
+   /* Stop the workers, then close everything                                          */
+   pthread_mutex_lock(&server.lock);
+   server.stopping = 1;
+   pthread_cond_broadcast(&server.work);
+   pthread_mutex_unlock(&server.lock);
+   for (index = 0; index < server.count; index++) {
+      pthread_join(server.workers[index], NULL);
+   }
+   while (server.open != NULL) {
+      server.open->busy = 0;
+      close_connection(&server, server.open);
+   }
+   if (server.listener >= 0) {
+      close(server.listener);
+      unlink(options->socket_path);
+   }
+   if (server.events >= 0) {
+      close(server.events);
+   }
+   if (server.wakeup >= 0) {
+      close(server.wakeup);
+   }
+   if (status == 0) {
+      fprintf(stderr, "Served %llu requests, %llu with a key kept ready.\n",
+              server.served, server.cache.hits);
+   }
+   clear_cache(&server.cache);
+   pthread_cond_destroy(&server.work);
+   pthread_mutex_destroy(&server.lock);
+
+   return status;
+}
+
+/* Takes every connection waiting on the listening socket                              */
+void   accept_connections(SERVER *server) {
+   CONNECTION         *connection; /* Points to the new connection                     */
+   struct epoll_event event;       /* Holds the events waited for on it                */
+   int                file;        /* Holds the socket of the new connection           */
+
+   while ((file = accept(server->listener, NULL, NULL)) >= 0 || errno == EINTR ||
+          errno == ECONNABORTED) {
+      if (file < 0) {
+         continue;
+      }
+      fcntl(file, F_SETFL, fcntl(file, F_GETFL) | O_NONBLOCK);
+      if ((connection = (CONNECTION *) calloc(1, sizeof(CONNECTION))) == NULL ||
+          (connection->data = (char *) malloc(SERVE_SIZE)) == NULL) {
+         fprintf(stderr, "Failed to allocate a connection.\n");
+         exit(1);
+      }
+      connection->file     = file;
+      connection->capacity = SERVE_SIZE;
+      connection->after    = server->open;
+      server->open         = connection;
+      event.events         = EPOLLIN | EPOLLRDHUP;
+      event.data.ptr       = connection;
+      epoll_ctl(server->events, EPOLL_CTL_ADD, file, &event);
+   }
+
+   return;
+}
+
+/* Reads what a connection has sent and hands it to a worker once a request is whole   */
+void   read_requests(SERVER *server, CONNECTION *connection) {
+   ssize_t length; /* Holds the characters one call received                           */
+
+   /* A connection holding a whole request stops reading until it is answered          */
+   while (connection->length < connection->capacity) {
+      length = recv(connection->file, connection->data + connection->length,
+                    connection->capacity - connection->length, 0);
+      if (length > 0) {
+         connection->length += (size_t) length;
+      } else if (length < 0 && errno == EINTR) {
+         continue;
+      } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         break;
+      } else if (length == 0) {
+         connection->finished = 1;
+         break;
+      } else {
+         close_connection(server, connection);
+         return;
+      }
+   }
+
+   /* A connection that has sent everything is still answered, and closed once no      */
+   /* whole request is left                                                            */
+   if (!dispatch_request(server, connection) ||
+       (connection->finished && !connection->busy)) {
+      close_connection(server, connection);
+   }
+
+   return;
+}
+
+/* Hands a connection to a worker if its next request is whole, giving 0 if the        */
+/* request is not one the server understands                                           */
+int    dispatch_request(SERVER *server, CONNECTION *connection) {
+   REQUEST request; /* Holds the header of the request                                 */
+   size_t  size;    /* Holds the characters of the whole request                       */
+
+   if (connection->length < sizeof(REQUEST)) {
+      return 1;
+   }
+   memcpy(&request, connection->data, sizeof(REQUEST));
+   if (request.magic != SERVE_MAGIC ||
+       (request.cipher != CAESAR && request.cipher != VIGENERE) ||
+       (request.action != ENCODE && request.action != DECODE) ||
+       request.key_length > SERVE_KEY || request.length > SERVE_CAP) {
+      return 0;
+   }
+
+   /* Make room for the rest of a request that has not all arrived                     */
+   size = sizeof(REQUEST) + request.key_length + request.length;
+   if (connection->length < size) {
+      if (connection->capacity < size) {
+         connection->data = (char *) realloc(connection->data, size);
+         if (connection->data == NULL) {
+            fprintf(stderr, "Failed to allocate a request.\n");
+            exit(1);
+         }
+         connection->capacity = size;
+      }
+      return 1;
+   }
+
+   /* Epoll reports a hang-up whatever it is asked for, so the socket leaves it while  */
+   /* a worker has the connection rather than wake the server on every pass            */
+   connection->used = size;
+   connection->busy = 1;
+   epoll_ctl(server->events, EPOLL_CTL_DEL, connection->file, NULL);
+   pthread_mutex_lock(&server->lock);
+   connection->next = NULL;
+   if (server->waiting == NULL) {
+      server->waiting = connection;
+   } else {
+      server->last->next = connection;
+   }
+   server->last = connection;
+   pthread_cond_signal(&server->work);
+   pthread_mutex_unlock(&server->lock);
+
+   return 1;
+}
+
+/* Sends as much of a connection's reply as the socket takes                           */
+void   send_reply(SERVER *server, CONNECTION *connection) {
+   ssize_t length; /* Holds the characters one call sent                               */
+
+   while (connection->sent < connection->size) {
+      length = send(connection->file, connection->data + connection->reply +
+                    connection->sent, connection->size - connection->sent, MSG_NOSIGNAL);
+      if (length >= 0) {
+         connection->sent += (size_t) length;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+         watch_connection(server, connection, EPOLLOUT);
+         return;
+      } else if (errno != EINTR) {
+         close_connection(server, connection);
+         return;
+      }
+   }
+
+   /* Drop the request answered and look at the next one, if it has arrived            */
+   server->served++;
+   memmove(connection->data, connection->data + connection->used,
+           connection->length - connection->used);
+   connection->length -= connection->used;
+   connection->used    = 0;
+   connection->size    = 0;
+   connection->sent    = 0;
+   watch_connection(server, connection, EPOLLIN | EPOLLRDHUP);
+   if (!dispatch_request(server, connection) ||
+       (connection->finished && !connection->busy)) {
+      close_connection(server, connection);
+   }
+
+   return;
+}
+
+/* Sets which events of a connection the server waits for                              */
+void   watch_connection(SERVER *server, CONNECTION *connection, unsigned events) {
+   struct epoll_event event; /* Holds the events waited for                            */
+
+   event.events   = events;
+   event.data.ptr = connection;
+   epoll_ctl(server->events, EPOLL_CTL_MOD, connection->file, &event);
+
+   return;
+}
+
+/* Closes a connection and frees it                                                    */
+void   close_connection(SERVER *server, CONNECTION *connection) {
+   CONNECTION **link; /* Points to what points to the connection                       */
+
+   /* A worker still answering it closes it when it hands it back                      */
+   if (connection->busy) {
+      connection->closing = 1;
+      return;
+   }
+   for (link = &server->open; *link != connection; link = &(*link)->after) {
+   }
+   *link = connection->after;
+   epoll_ctl(server->events, EPOLL_CTL_DEL, connection->file, NULL);
+   close(connection->file);
+   free(connection->data);
+   free(connection);
+
+   return;
+}
+
+/* Answers the requests handed to it until the server stops                            */
+void   *serve_worker(void *argument) {
+   SERVER             *server = (SERVER *) argument; /* Points to the server           */
+   CONNECTION         *connection;                   /* Points to the one answered     */
+   unsigned long long one = 1;                       /* Holds what wakes the server    */
+
+   for (;;) {
+      pthread_mutex_lock(&server->lock);
+      while (server->waiting == NULL && !server->stopping) {
+         pthread_cond_wait(&server->work, &server->lock);
+      }
+      if (server->stopping) {
+         pthread_mutex_unlock(&server->lock);
+         break;
+      }
+      connection      = server->waiting;
+      server->waiting = connection->next;
+      pthread_mutex_unlock(&server->lock);
+
+      answer_request(server, connection);
+
+      pthread_mutex_lock(&server->lock);
+      connection->next = server->answered;
+      server->answered = connection;
+      pthread_mutex_unlock(&server->lock);
+      if (write(server->wakeup, &one, sizeof(one)) < 0) {
+         continue;
+      }
+   }
+
+   return NULL;
+}
+
+/* Changes the payload of a connection's request in place and writes the reply header  */
+/* in front of it                                                                      */
+void   answer_request(SERVER *server, CONNECTION *connection) {
+   REQUEST request; /* Holds the header of the request                                 */
+   REPLY   reply;   /* Holds the header of the reply                                   */
+   ENTRY   *entry;  /* Points to the cipher the request asks for                       */
+   char    *key,    /* Points to the key of the request                                */
+           *payload; /* Points to the payload of the request                           */
+
+   memcpy(&request, connection->data, sizeof(REQUEST));
+   key     = connection->data + sizeof(REQUEST);
+   payload = key + request.key_length;
+
+   entry = find_cipher(&server->cache, request.cipher, request.rotation, key,
+                       request.key_length);
+   reply.status = entry == NULL ? errno : 0;
+   reply.length = entry == NULL ? 0 : request.length;
+   if (entry != NULL) {
+      if (request.action == ENCODE) {
+         cipher_encrypt(entry->context, payload, payload, request.length);
+      } else {
+         cipher_decrypt(entry->context, payload, payload, request.length);
+      }
+      release_cipher(&server->cache, entry);
+   }
+
+   /* The header of the request is larger than that of the reply, so it has room       */
+   connection->reply = (size_t) (payload - connection->data) - sizeof(REPLY);
+   connection->size  = sizeof(REPLY) + reply.length;
+   connection->sent  = 0;
+   memcpy(connection->data + connection->reply, &reply, sizeof(REPLY));
+
+   return;
+}
+#else
+int    serve_requests(OPTIONS *options) {
+   fprintf(stderr, "Serving %s needs epoll, which this system does not have.\n",
+           options->socket_path);
+
+   return 1;
+}
+#endif
+
+/* Finds the cipher of a request among those kept ready, making it if it is not, or    */
+/* gives NULL with errno set when the key has no letters                               */
+/* The key is normalized to its lowercase letters first, so keys differing only in     */
+/* case or punctuation share one cipher. A cipher is made outside the lock, and the    */
+/* least recently used one is dropped to make room.                                    */
+ENTRY  *find_cipher(CACHE *cache, char cipher, int rotation, const char *key,
+                    size_t length) {
+   char          letters[SERVE_KEY + 1]; /* Holds the letters of the key               */
+   size_t        count = 0,              /* Holds the number of letters                */
+                 index;                  /* Holds the character being looked at        */
+   unsigned long hash  = 2166136261UL;   /* Holds the hash being worked out            */
+   ENTRY         *entry,                 /* Points to the entry found or made          */
+                 *made;                  /* Points to the entry made here              */
+
+   /* Hash the cipher and its normalized rotation or key, whose letters are only the   */
+   /* ASCII ones, as in the library, whatever the locale                               */
+   if (cipher == CAESAR) {
+      rotation = (rotation % ALPHABET + ALPHABET) % ALPHABET;
+   } else {
+      rotation = 0;
+      for (index = 0; index < length; index++) {
+         if (key[index] >= 'a' && key[index] <= 'z') {
+            letters[count++] = key[index];
+         } else if (key[index] >= 'A' && key[index] <= 'Z') {
+            letters[count++] = (char) (key[index] - 'A' + 'a');
+         }
+      }
+      if (count == 0) {
+         errno = EINVAL;
+         return NULL;
+      }
+   }
+   letters[count] = '\0';
+   hash = (hash ^ (unsigned char) cipher) * 16777619UL;
+   hash = (hash ^ (unsigned long) rotation) * 16777619UL;
+   for (index = 0; index < count; index++) {
+      hash = (hash ^ (unsigned char) letters[index]) * 16777619UL;
+   }
+
+   for (made = NULL;;) {
+      pthread_mutex_lock(&cache->lock);
+      for (entry = cache->buckets[hash & cache->mask]; entry != NULL;
+           entry = entry->next) {
+         if (entry->hash == hash && entry->cipher == cipher &&
+             entry->rotation == rotation && entry->length == count &&
+             memcmp(entry->key, letters, count) == 0) {
+            break;
+         }
+      }
+
+      /* Move the entry found to the front of the order of use                         */
+      if (entry != NULL) {
+         if (made == NULL) {
+            cache->hits++;
+         }
+         if (cache->newest != entry) {
+            entry->newer->older = entry->older;
+            if (entry->older != NULL) {
+               entry->older->newer = entry->newer;
+            } else {
+               cache->oldest = entry->newer;
+            }
+            entry->older        = cache->newest;
+            entry->newer        = NULL;
+            cache->newest->newer = entry;
+            cache->newest       = entry;
+         }
+         entry->users++;
+         pthread_mutex_unlock(&cache->lock);
+         if (made != NULL) {
+            cipher_destroy(made->context);
+            free(made->key);
+            free(made);
+         }
+         return entry;
+      }
+
+      /* Put the entry made in, unless another worker made the same one meanwhile      */
+      if (made != NULL) {
+         break;
+      }
+      cache->misses++;
+      pthread_mutex_unlock(&cache->lock);
+
+      if ((made = (ENTRY *) calloc(1, sizeof(ENTRY))) == NULL ||
+          (made->key = (char *) malloc(count + 1)) == NULL) {
+         fprintf(stderr, "Failed to allocate a cipher.\n");
+         exit(1);
+      }
+      memcpy(made->key, letters, count + 1);
+      made->cipher   = cipher;
+      made->rotation = rotation;
+      made->length   = count;
+      made->hash     = hash;
+      made->context  = cipher == CAESAR ? cipher_create_caesar(rotation)
+                                        : cipher_create_vigenere(letters, count);
+      if (made->context == NULL) {
+         fprintf(stderr, "Failed to allocate a cipher.\n");
+         exit(1);
+      }
+   }
+
+   made->users   = 1;
+   made->next    = cache->buckets[hash & cache->mask];
+   made->older   = cache->newest;
+   cache->buckets[hash & cache->mask] = made;
+   if (cache->newest != NULL) {
+      cache->newest->newer = made;
+   } else {
+      cache->oldest = made;
+   }
+   cache->newest = made;
+   if (++cache->count > cache->capacity) {
+      entry = cache->oldest;
+      forget_entry(cache, entry);
+      if (entry->users == 0) {
+         cipher_destroy(entry->context);
+         free(entry->key);
+         free(entry);
+      } else {
+         entry->evicted = 1;
+      }
+   }
+   pthread_mutex_unlock(&cache->lock);
+
+   return made;
+}
+
+/* Gives back a cipher found in the cache, deleting it if it was dropped meanwhile     */
+void   release_cipher(CACHE *cache, ENTRY *entry) {
+   int dropped; /* Holds whether the entry is no longer in the cache or in use         */
+
+   pthread_mutex_lock(&cache->lock);
+   dropped = --entry->users == 0 && entry->evicted;
+   pthread_mutex_unlock(&cache->lock);
+   if (dropped) {
+      cipher_destroy(entry->context);
+      free(entry->key);
+      free(entry);
+   }
+
+   return;
+}
+
+/* Takes an entry out of the cache's table and order of use                            */
+void   forget_entry(CACHE *cache, ENTRY *entry) {
+   ENTRY **link; /* Points to what points to the entry in its bucket                   */
+
+   for (link = &cache->buckets[entry->hash & cache->mask]; *link != entry;
+        link = &(*link)->next) {
+   }
+   *link = entry->next;
+   if (entry->newer != NULL) {
+      entry->newer->older = entry->older;
+   } else {
+      cache->newest = entry->older;
+   }
+   if (entry->older != NULL) {
+      entry->older->newer = entry->newer;
+   } else {
+      cache->oldest = entry->newer;
+   }
+   cache->count--;
+
+   return;
+}
+
+/* Deletes every cipher in the cache                                                   */
+void   clear_cache(CACHE *cache) {
+   ENTRY *entry; /* Points to the entry being deleted                                  */
+
+   while ((entry = cache->oldest) != NULL) {
+      forget_entry(cache, entry);
+      cipher_destroy(entry->context);
+      free(entry->key);
+      free(entry);
+   }
+   free(cache->buckets);
+   pthread_mutex_destroy(&cache->lock);
+
+   return;
+}
+
+/* Marks that the server has been asked to stop                                        */
+void   stop_serving(int signal) {
+   (void) signal;
+   stop_requested = 1;
+
+   return;
+}
+
+/* Creates a socket listening at a path, or gives -1 with errno set                    */
+/* A socket left behind by a server that did not shut down is replaced.                */
+int    open_listener(const char *path) {
+   struct sockaddr_un address; /* Holds the path as a socket address                   */
+   struct stat        status;  /* Holds the type of whatever is at the path            */
+   int                file,    /* Holds the socket                                     */
+                      error;   /* Holds the error from setting it up                   */
+
+   if (strlen(path) >= sizeof(address.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, path);
+   if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+      unlink(path);
+   }
+
+   if ((file = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+   }
+   if (bind(file, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+       listen(file, SOMAXCONN) != 0 ||
+       fcntl(file, F_SETFL, fcntl(file, F_GETFL) | O_NONBLOCK) != 0) {
+      error = errno;
+      close(file);
+      errno = error;
+      return -1;
+   }
+
+   return file;
+}
+
+/* Connects to a socket at a path, or gives -1 with errno set                          */
+int    connect_socket(const char *path) {
+   struct sockaddr_un address; /* Holds the path as a socket address                   */
+   int                file,    /* Holds the socket                                     */
+                      error;   /* Holds the error from connecting                      */
+
+   if (strlen(path) >= sizeof(address.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, path);
+
+   if ((file = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+   }
+   if (connect(file, (struct sockaddr *) &address, sizeof(address)) != 0) {
+      error = errno;
+      close(file);
+      errno = error;
+      return -1;
+   }
+
+   return file;
+}
+
+/* Reads exactly the given number of characters, giving 0 if they do not all arrive    */
+int    read_all(int file, char *characters, size_t length) {
+   ssize_t got; /* Holds the number of characters one call read                        */
+
+   while (length > 0) {
+      if ((got = read(file, characters, length)) <= 0) {
+         if (got < 0 && errno == EINTR) {
+            continue;
+         }
+         if (got == 0) {
+            errno = ECONNRESET;
+         }
+         return 0;
+      }
+      characters += got;
+      length     -= (size_t) got;
+   }
+
+   return 1;
+}
+
+/* Sends stdin to the server as one request and writes the reply to stdout             */
+int    send_request(OPTIONS *options) {
+   TEXT         *message;  /* Points to the message sent                               */
+   REQUEST      request;   /* Holds the header of the request                          */
+   REPLY        reply;     /* Holds the header of the reply                            */
+   struct iovec pieces[3]; /* Holds the header, key and payload to send                */
+   ssize_t      length;    /* Holds the characters one read gave                       */
+   int          file,      /* Holds the connection to the server                       */
+                status = 0; /* Holds the exit status of the program                    */
+
+   /* A server that hangs up is an error to report, not a signal that ends the program */
+   signal(SIGPIPE, SIG_IGN);
+
+   /* Read the whole message, since a request carries it in one piece                  */
+   message = create_string();
+   reserve_string(message, CHUNK_SIZE);
+   while ((length = read(STDIN_FILENO, message->characters + message->length,
+                         message->capacity - message->length)) != 0) {
+      if (length < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         fprintf(stderr, "Failed to read the message: %s\n", strerror(errno));
+         clear_string(message);
+         return 1;
+      }
+      message->length += (size_t) length;
+      if (message->length > SERVE_CAP) {
+         fprintf(stderr, "The message is larger than the server takes.\n");
+         clear_string(message);
+         return 1;
+      }
+      if (message->length == message->capacity) {
+         reserve_string(message, message->capacity * 2);
+      }
+   }
+
+   memset(&request, 0, sizeof(request));
+   request.magic      = SERVE_MAGIC;
+   request.cipher     = options->cipher;
+   request.action     = options->action;
+   request.rotation   = options->rotation;
+   request.key_length = options->key == NULL ? 0 : (unsigned) strlen(options->key);
+   request.length     = (unsigned) message->length;
+   pieces[0].iov_base = &request;
+   pieces[0].iov_len  = sizeof(request);
+   pieces[1].iov_base = options->key;
+   pieces[1].iov_len  = request.key_length;
+   pieces[2].iov_base = message->characters;
+   pieces[2].iov_len  = message->length;
+
+   if ((file = connect_socket(options->socket_path)) < 0) {
+      fprintf(stderr, "Failed to connect to %s: %s\n", options->socket_path,
+              strerror(errno));
+      status = 1;
+   } else if (request.key_length > SERVE_KEY) {
+      fprintf(stderr, "The key is longer than the server takes.\n");
+      status = 1;
+   } else if (!write_vector(file, pieces, 3) ||
+              !read_all(file, (char *) &reply, sizeof(reply)) ||
+              (reply.status == 0 && reply.length > message->length) ||
+              !read_all(file, message->characters, reply.length)) {
+      fprintf(stderr, "Failed to talk to %s: %s\n", options->socket_path,
+              strerror(errno));
+      status = 1;
+   } else if (reply.status != 0) {
+      fprintf(stderr, "The server refused the request: %s\n", strerror(reply.status));
+      status = 1;
+   } else if (!write_all(STDOUT_FILENO, message->characters, reply.length)) {
+      fprintf(stderr, "Failed to write the message: %s\n", strerror(errno));
+      status = 1;
+   }
+   if (file >= 0) {
+      close(file);
+   }
+   clear_string(message);
+
+   return status;
+}
+
+/* Times a server with many small requests over several connections                    */
+/* Each connection sends its requests one at a time, each with one of a set of random  */
+/* keys, and the time from sending a request to having its reply is kept for each.     */
+int    generate_load(OPTIONS *options) {
+   LOAD               loads[CIPHER_MAX_THREADS]; /* Holds each connection's share      */
+   char               keys[LOAD_KEYS * LOAD_KEY]; /* Holds the keys picked between     */
+   double             *seconds,                  /* Points to the time of each request */
+                      started;                   /* Holds the clock at the start       */
+   unsigned long long seed = BENCH_SEED;         /* Holds the random numbers' state    */
+   size_t             index,                     /* Holds the key letter being made    */
+                      offset = 0;                /* Holds the first time of a share    */
+   int                load,                      /* Holds the connection being started */
+                      error  = 0;                /* Holds the first error any had      */
+
+   /* A server that hangs up is an error to report, not a signal that ends the program */
+   signal(SIGPIPE, SIG_IGN);
+   for (index = 0; index < sizeof(keys); index++) {
+      keys[index] = (char) (LOWER_INT + next_random(&seed) % ALPHABET);
+   }
+   if ((seconds = (double *) malloc(options->requests * sizeof(double))) == NULL) {
+      fprintf(stderr, "Failed to allocate the times.\n");
+      exit(1);
+   }
+
+   /* Split the requests between the connections as evenly as they go                  */
+   started = read_clock();
+   for (load = 0; load < options->connections; load++) {
+      loads[load].options = options;
+      loads[load].keys    = keys;
+      loads[load].count   = options->requests / options->connections +
+                            ((size_t) load < options->requests % options->connections);
+      loads[load].seconds = seconds + offset;
+      loads[load].seed    = next_random(&seed) | 1;
+      loads[load].error   = 0;
+      offset             += loads[load].count;
+      if (load > 0 &&
+          pthread_create(&loads[load].thread, NULL, load_task, &loads[load]) != 0) {
+         loads[load].thread = pthread_self();
+         load_task(&loads[load]);
+      }
+   }
+   load_task(&loads[0]);
+   for (load = 1; load < options->connections; load++) {
+      if (!pthread_equal(loads[load].thread, pthread_self())) {
+         pthread_join(loads[load].thread, NULL);
+      }
+      error = error != 0 ? error : loads[load].error;
+   }
+   started = read_clock() - started;
+   error   = loads[0].error != 0 ? loads[0].error : error;
+
+   if (error != 0) {
+      fprintf(stderr, "Failed to load %s: %s\n", options->socket_path, strerror(error));
+      free(seconds);
+      return 1;
+   }
+   qsort(seconds, options->requests, sizeof(double), compare_seconds);
+   printf(options->json
+             ? "{\"requests\": %lu, \"connections\": %d, \"size\": %lu, "
+               "\"seconds\": %.3f, \"requests_per_s\": %.0f, \"mb_per_s\": %.1f, "
+               "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}\n"
+             : "requests,connections,size,seconds,requests_per_s,mb_per_s,"
+               "p50_us,p99_us,max_us\n%lu,%d,%lu,%.3f,%.0f,%.1f,%.1f,%.1f,%.1f\n",
+          (unsigned long) options->requests, options->connections,
+          (unsigned long) options->payload, started, options->requests / started,
+          (double) options->requests * options->payload / started / 1e6,
+          seconds[options->requests / 2] * 1e6,
+          seconds[(options->requests - 1) * 99 / 100] * 1e6,
+          seconds[options->requests - 1] * 1e6);
+   free(seconds);
+
+   return 0;
+}
+
+/* Sends one connection's share of the load generator's requests                       */
+void   *load_task(void *task) {
+   LOAD    *load = (LOAD *) task; /* Points to the connection's share                  */
+   REQUEST request;               /* Holds the header of each request                  */
+   REPLY   reply;                 /* Holds the header of each reply                    */
+   char    *buffer;               /* Points to the request, then to its reply          */
+   size_t  size,                  /* Holds the characters of a whole request           */
+           index;                 /* Holds the request being sent                      */
+   double  started;               /* Holds the clock when a request was sent           */
+   int     file;                  /* Holds the connection to the server                */
+
+   if ((file = connect_socket(load->options->socket_path)) < 0) {
+      load->error = errno;
+      return NULL;
+   }
+   size = sizeof(REQUEST) + LOAD_KEY + load->options->payload;
+   if ((buffer = (char *) malloc(size)) == NULL) {
+      fprintf(stderr, "Failed to allocate a request.\n");
+      exit(1);
+   }
+
+   memset(&request, 0, sizeof(request));
+   request.magic      = SERVE_MAGIC;
+   request.cipher     = VIGENERE;
+   request.action     = ENCODE;
+   request.key_length = LOAD_KEY;
+   request.length     = (unsigned) load->options->payload;
+   for (index = 0; index < load->count; index++) {
+      memcpy(buffer, &request, sizeof(request));
+      memcpy(buffer + sizeof(request),
+             load->keys + next_random(&load->seed) % LOAD_KEYS * LOAD_KEY, LOAD_KEY);
+      fill_corpus(buffer + sizeof(request) + LOAD_KEY, load->options->payload, 1,
+                  &load->seed);
+
+      reply.status = 0;
+      started      = read_clock();
+      if (!write_all(file, buffer, size) ||
+          !read_all(file, (char *) &reply, sizeof(reply)) ||
+          reply.length != request.length ||
+          !read_all(file, buffer, reply.length)) {
+         load->error = reply.status != 0 ? reply.status : errno;
+         break;
+      }
+      load->seconds[index] = read_clock() - started;
+   }
+   close(file);
+   free(buffer);
+
+   return NULL;
+}
+
+/* Orders two times for sorting                                                        */
+int    compare_seconds(const void *first, const void *second) {
+   double left  = *(const double *) first,  /* Holds the first time                    */
+          right = *(const double *) second; /* Holds the second time                   */
+
+   return (left > right) - (left < right);
+}
+
+/* Creates a stream that applies the chosen cipher and action to one message           */
+CIPHER_STREAM *create_stream(OPTIONS *options) {
+   CIPHER_STREAM *stream; /* Points to the new stream                                  */
+
+   stream = cipher_stream_create(options->context, options->action == ENCODE
+                                                      ? CIPHER_ENCRYPT : CIPHER_DECRYPT);
+   if (stream == NULL) {
+      fprintf(stderr, "Failed to allocate the stream.\n");
+      exit(1);
+   }
+
+   return stream;
+}
+
+/* Measures how fast each cipher runs over made-up messages of many sizes and kinds,   */
+/* printing one record per run as CSV or JSON so results can be compared over time     */
+int    run_benchmark(OPTIONS *options) {
+   static const char   *corpora[]    = {"lowercase", "mixed", "punctuation", "binary",
+                                          "utf8"};
+                                         /* Holds the name of each kind of message     */
+   static const size_t key_lengths[] = {0, 1, 8, 64};
+                                         /* Holds the key lengths tried, 0 for caesar  */
+   TEXT               *message,          /* Points to the made-up message              */
+                      *key;              /* Points to the made-up key                  */
+   OPTIONS            run = *options;    /* Holds the options of the run being timed   */
+   struct rusage      usage;             /* Holds the peak memory of the program       */
+   CIPHER_STREAM      *stream;           /* Holds the position in the key              */
+   size_t             size,              /* Holds the size of the message being timed  */
+                      index;             /* Holds the character of the key being made  */
+   unsigned long      iterations,        /* Holds the number of times the cipher ran   */
+                      batch,             /* Holds the runs between readings of a clock */
+                      run_index;         /* Holds the run of the batch being made      */
+   unsigned long long seed = BENCH_SEED, /* Holds the state of the random numbers      */
+                      cycles;            /* Holds the cycles the runs took             */
+   double             seconds;           /* Holds the time the runs took               */
+   int                corpus,            /* Holds the kind of message being timed      */
+                      length,            /* Holds the key length being timed           */
+                      direction,         /* Holds whether encoding or decoding is run  */
+                      first = 1;         /* Holds whether no record was printed yet    */
+
+   message = create_string();
+   reserve_string(message, options->max_size);
+   key = create_string();
+
+   if (options->json) {
+      printf("[");
+   } else {
+      printf("corpus,size,cipher,action,key_length,threads,kernel,iterations,"
+             "mb_per_s,cycles_per_byte\n");
+   }
+
+   for (corpus = 0; corpus < (int) (sizeof(corpora) / sizeof(corpora[0])); corpus++) {
+      fill_corpus(message->characters, options->max_size, corpus, &seed);
+      for (size = BENCH_MIN; size <= options->max_size; size *= BENCH_STEP) {
+         for (length = 0; length < (int) (sizeof(key_lengths) / sizeof(key_lengths[0]));
+              length++) {
+
+            /* Make a key of the length being timed, or use the caesar cipher          */
+            run.cipher = key_lengths[length] == 0 ? CAESAR : VIGENERE;
+            if (run.cipher == VIGENERE) {
+               key->length = 0;
+               for (index = 0; index < key_lengths[length]; index++) {
+                  add_character(key, (char) (LOWER_INT + next_random(&seed) % ALPHABET));
+               }
+               run.context = cipher_create_vigenere(key->characters, key->length);
+            } else {
+               run.context = cipher_create_caesar(13);
+            }
+            if (run.context == NULL) {
+               fprintf(stderr, "Failed to allocate the cipher.\n");
+               clear_string(message);
+               clear_string(key);
+               return 1;
+            }
+            run.threads = cipher_set_threads(run.context, options->threads);
+
+            for (direction = 0; direction < 2; direction++) {
+               run.action = direction == 0 ? ENCODE : DECODE;
+
+               /* Run the cipher until enough time has passed to trust the clock, in   */
+               /* batches that double in size so that reading the clock between them   */
+               /* costs nothing next to the runs, however small the message            */
+               iterations = 0;
+               stream     = create_stream(&run);
+               seconds    = read_clock();
+               cycles     = read_cycles();
+               batch      = 1;
+               do {
+                  for (run_index = 0; run_index < batch; run_index++) {
+                     cipher_stream_update(stream, message->characters,
+                                          message->characters, size);
+                  }
+                  iterations += batch;
+                  batch      *= 2;
+               } while (read_clock() - seconds < BENCH_TIME);
+               cycles  = read_cycles() - cycles;
+               seconds = read_clock() - seconds;
+               cipher_stream_destroy(stream);
+
+               print_run(options, &first, corpora[corpus], size,
+                         run.cipher == CAESAR ? "caesar" : "vigenere", run.action,
+                         key_lengths[length], run.threads,
+                         cipher_kernel_name(run.context), (double) size * iterations,
+                         seconds, cycles, iterations);
+            }
+
+            cipher_destroy(run.context);
+         }
+      }
+      if (benchmark_batch(options, message, corpora[corpus], &seed, &first) != 0) {
+         clear_string(message);
+         clear_string(key);
+         return 1;
+      }
+   }
+   if (options->json) {
+      printf("\n]\n");
+   }
+
+   /* The peak is of the whole run, which holds the largest message from the start, so */
+   /* it is reported once rather than against every record                             */
+   fflush(stdout);
+   getrusage(RUSAGE_SELF, &usage);
+   fprintf(stderr, "Peak memory: %ld KB\n", usage.ru_maxrss);
+
+   clear_string(message);
+   clear_string(key);
+
+   return 0;
+}
+
+/* Times the batch interface over many small records, each with a key of its own       */
+/* The records are the smallest benchmark size and spread at random over a table of    */
+/* 8-letter keys, so the result can be set against one large message with such a key.  */
+int    benchmark_batch(OPTIONS *options, TEXT *message, const char *corpus,
+                       unsigned long long *seed, int *first) {
+   CIPHER             *ciphers[BENCH_KEYS]; /* Holds the table of keys                 */
+   CIPHER_RECORD      *records;             /* Points to the records of the batch      */
+   char               letters[8];           /* Holds the key being made                */
+   size_t             size,                 /* Holds the characters of the whole batch */
+                      count,                /* Holds the number of records             */
+                      index,                /* Holds the key or record being made      */
+                      letter;               /* Holds the letter of the key being made  */
+   unsigned long      iterations,           /* Holds the number of times the batch ran */
+                      batch,                /* Holds the runs between clock readings   */
+                      run;                  /* Holds the run of the batch being made   */
+   unsigned long long cycles;               /* Holds the cycles the runs took          */
+   double             seconds;              /* Holds the time the runs took            */
+   int                threads,              /* Holds the threads the batch is split in */
+                      direction,            /* Holds whether encoding or decoding runs */
+                      status = 0;           /* Holds whether everything was allocated  */
+
+   /* Make the keys and cut the message into records that each pick one                */
+   size    = options->max_size < MAP_WINDOW ? options->max_size : MAP_WINDOW;
+   count   = size / BENCH_MIN;
+   records = (CIPHER_RECORD *) malloc(count * sizeof(CIPHER_RECORD));
+   for (index = 0; index < BENCH_KEYS; index++) {
+      for (letter = 0; letter < sizeof(letters); letter++) {
+         letters[letter] = (char) (LOWER_INT + next_random(seed) % ALPHABET);
+      }
+      if ((ciphers[index] = cipher_create_vigenere(letters, sizeof(letters))) == NULL) {
+         status = 1;
+      }
+   }
+   if (records == NULL || status != 0) {
+      fprintf(stderr, "Failed to allocate the batch.\n");
+      status = 1;
+   }
+   for (index = 0; status == 0 && index < count; index++) {
+      records[index].offset = index * BENCH_MIN;
+      records[index].length = BENCH_MIN;
+      records[index].key    = (size_t) (next_random(seed) % BENCH_KEYS);
+   }
+   threads = status == 0 ? cipher_set_threads(ciphers[0], options->threads) : 1;
+
+   for (direction = 0; status == 0 && direction < 2; direction++) {
+
+      /* Run the batch until enough time has passed to trust the clock, in runs that   */
+      /* double in number between readings of the clock                                */
+      iterations = 0;
+      seconds    = read_clock();
+      cycles     = read_cycles();
+      batch      = 1;
+      do {
+         for (run = 0; run < batch; run++) {
+            cipher_batch((const CIPHER *const *) ciphers, records, count,
+                         direction == 0 ? CIPHER_ENCRYPT : CIPHER_DECRYPT,
+                         message->characters, message->characters, threads);
+         }
+         iterations += batch;
+         batch      *= 2;
+      } while (read_clock() - seconds < BENCH_TIME);
+      cycles  = read_cycles() - cycles;
+      seconds = read_clock() - seconds;
+
+      print_run(options, first, corpus, BENCH_MIN, "batch",
+                direction == 0 ? ENCODE : DECODE, sizeof(letters), threads,
+                cipher_kernel_name(ciphers[0]), (double) size * iterations, seconds,
+                cycles, iterations);
+   }
+
+   for (index = 0; index < BENCH_KEYS; index++) {
+      cipher_destroy(ciphers[index]);
+   }
+   free(records);
+
+   return status;
+}
+
+/* Prints one benchmark record as CSV or JSON                                          */
+void   print_run(OPTIONS *options, int *first, const char *corpus, size_t size,
+                 const char *cipher, char action, size_t key_length, int threads,
+                 const char *kernel, double characters, double seconds,
+                 unsigned long long cycles, unsigned long iterations) {
+   printf(options->json
+             ? "%s\n {\"corpus\": \"%s\", \"size\": %lu, "
+               "\"cipher\": \"%s\", \"action\": \"%s\", "
+               "\"key_length\": %lu, \"threads\": %d, \"kernel\": \"%s\", "
+               "\"iterations\": %lu, \"mb_per_s\": %.1f, "
+               "\"cycles_per_byte\": %.3f}"
+             : "%s%s,%lu,%s,%s,%lu,%d,%s,%lu,%.1f,%.3f\n",
+          options->json ? (*first ? "" : ",") : "",
+          corpus, (unsigned long) size, cipher,
+          action == ENCODE ? "encode" : "decode",
+          (unsigned long) key_length, threads, kernel,
+          iterations, characters / seconds / 1e6, (double) cycles / characters);
+   fflush(stdout);
+   *first = 0;
+
+   return;
+}
+
+/* Checks the ciphers against changing a message the slow way, printing each check,    */
+/* and gives 0 when every one passes                                                   */
+int    run_checks() {
+   const char *failed;     /* Points to the kernel that gave the wrong output          */
+   int        status = 0;  /* Holds the exit status of the program                     */
+
+   /* Every kernel, vector or portable, against a character at a time                  */
+   if ((failed = cipher_check_kernels()) != NULL) {
+      printf("FAIL kernels: %s differs from a character at a time\n", failed);
+      status = 1;
+   } else {
+      printf("ok   kernels\n");
+   }
+
+   /* Folded chains against their stages run one after another                         */
+   status |= check_chains();
+
+   return status;
+}
+
+/* Checks that chains fold to ciphers that change a message, split anywhere, as their  */
+/* stages do one after another, and that a folded key too long is refused              */
+int    check_chains() {
+   static const char *const specs[CHAIN_CHECKS] = {
+      "caesar:3,vigenere:lemon,vigenere:key", "rot13,c:5", "rot13,rot13",
+      "v:ab,vigenere:A-B-C,c:-1"
+   };                                  /* Holds the chains checked                     */
+   static const char *const keys[CHAIN_CHECKS][3] = {
+      {NULL, "lemon", "key"}, {NULL, NULL, ""}, {NULL, NULL, ""}, {"ab", "A-B-C", NULL}
+   };                                  /* Holds each stage's key, NULL for a rotation, */
+                                       /* or "" past the last stage                    */
+   static const int rotations[CHAIN_CHECKS][3] = {
+      {3, 0, 0}, {13, 5, 0}, {13, 13, 0}, {0, 0, -1}
+   };                                  /* Holds the rotation of each caesar stage      */
+   CIPHER             *stages[3],      /* Points to the cipher of each stage           */
+                      *chain;          /* Points to the cipher they fold to            */
+   CIPHER_STREAM      *stream;         /* Points to the stream changing the pieces     */
+   char               *message,        /* Points to the message changed                */
+                      *expected,       /* Points to it changed by each stage in turn   */
+                      *changed,        /* Points to it changed by the chain            */
+                      *key;            /* Points to the longest key a chain folds to   */
+   unsigned long long seed = BENCH_SEED;
+                                       /* Holds the state of the random numbers        */
+   size_t             offset,          /* Holds where the next piece starts            */
+                      piece;           /* Holds the characters in the piece            */
+   int                check,           /* Holds the chain being checked                */
+                      count,           /* Holds the number of stages in it             */
+                      stage,           /* Holds the stage being deleted                */
+                      pass,            /* Holds whether it encrypts or decrypts        */
+                      passed,          /* Holds whether the chain passed               */
+                      status = 0;      /* Holds whether every chain passed             */
+
+   message  = (char *) malloc(CHAIN_SIZE);
+   expected = (char *) malloc(CHAIN_SIZE);
+   changed  = (char *) malloc(CHAIN_SIZE);
+   key      = (char *) malloc(CIPHER_MAX_CHAIN);
+   if (message == NULL || expected == NULL || changed == NULL || key == NULL) {
+      fprintf(stderr, "Failed to allocate the messages to check.\n");
+      free(message);
+      free(expected);
+      free(changed);
+      free(key);
+      return 1;
+   }
+   fill_corpus(message, CHAIN_SIZE, 2, &seed);
+
+   for (check = 0; check < CHAIN_CHECKS; check++) {
+      /* Change the message with each stage in turn                                    */
+      memcpy(expected, message, CHAIN_SIZE);
+      for (count = 0; count < 3 && (keys[check][count] == NULL ||
+                                    keys[check][count][0] != '\0'); count++) {
+         stages[count] = keys[check][count] == NULL
+                            ? cipher_create_caesar(rotations[check][count])
+                            : cipher_create_vigenere(keys[check][count],
+                                                     strlen(keys[check][count]));
+         cipher_encrypt(stages[count], expected, expected, CHAIN_SIZE);
+      }
+
+      /* The folded chain must give the same a piece at a time, with pieces shorter    */
+      /* than the folded key so they end all over it, and decrypt back                 */
+      chain  = create_chain(specs[check]);
+      passed = chain != NULL;
+      for (pass = 0; passed && pass < 2; pass++) {
+         stream = cipher_stream_create(chain, pass == 0 ? CIPHER_ENCRYPT
+                                                        : CIPHER_DECRYPT);
+         if (stream == NULL) {
+            fprintf(stderr, "Failed to allocate a stream.\n");
+            passed = 0;
+            break;
+         }
+         for (offset = 0; offset < CHAIN_SIZE; offset += piece) {
+            piece = (size_t) (next_random(&seed) % 40);
+            piece = piece < CHAIN_SIZE - offset ? piece : CHAIN_SIZE - offset;
+            cipher_stream_update(stream, (pass == 0 ? message : changed) + offset,
+                                 changed + offset, piece);
+         }
+         cipher_stream_destroy(stream);
+         passed = memcmp(changed, pass == 0 ? expected : message, CHAIN_SIZE) == 0;
+      }
+
+      /* Rotations alone fold to a caesar cipher, and rotations that cancel to a copy  */
+      if (passed && check == 1) {
+         passed = cipher_key(chain)[0] == '\0' && cipher_rotation(chain) == 18;
+      } else if (passed && check == 2) {
+         passed = strcmp(cipher_kernel_name(chain), "copy") == 0;
+      }
+      printf(passed ? "ok   chain %s\n" : "FAIL chain %s\n", specs[check]);
+      status |= !passed;
+      cipher_destroy(chain);
+      for (stage = 0; stage < count; stage++) {
+         cipher_destroy(stages[stage]);
+      }
+   }
+
+   /* A key of CIPHER_MAX_CHAIN letters folds, and one three times as long is refused  */
+   for (offset = 0; offset < CIPHER_MAX_CHAIN; offset++) {
+      key[offset] = (char) (LOWER_INT + next_random(&seed) % ALPHABET);
+   }
+   stages[0] = cipher_create_vigenere(key, CIPHER_MAX_CHAIN);
+   stages[1] = cipher_create_caesar(1);
+   stages[2] = cipher_create_vigenere("abc", 3);
+   chain     = cipher_create_chain((const CIPHER *const *) stages, 2);
+   passed    = chain != NULL && strlen(cipher_key(chain)) == CIPHER_MAX_CHAIN;
+   cipher_destroy(chain);
+   chain     = cipher_create_chain((const CIPHER *const *) stages, 3);
+   passed   &= chain == NULL && errno == E2BIG;
+   printf(passed ? "ok   chain length limit\n" : "FAIL chain length limit\n");
+   status |= !passed;
+   cipher_destroy(chain);
+   for (stage = 0; stage < 3; stage++) {
+      cipher_destroy(stages[stage]);
+   }
+
+   free(message);
+   free(expected);
+   free(changed);
+   free(key);
+
+   return status;
+}
+
+/* Fills a buffer with a made-up message of one kind                                   */
+void   fill_corpus(char *characters, size_t length, int corpus,
+                   unsigned long long *seed) {
+   static const char  punctuation[] = " .,;:!?'\"-()[]{}<>/\\@#$%^&*_+=|~`0123456789\n";
+                                      /* Holds the characters between letters          */
+   unsigned long long random;         /* Holds the random number being used up         */
+   size_t             index;          /* Holds the character being made                */
+
+   for (index = 0; index < length; index++) {
+      random = next_random(seed);
+      if (corpus == 0) {
+         characters[index] = (char) (LOWER_INT + random % ALPHABET);
+      } else if (corpus == 1) {
+         characters[index] = random % 6 == 0 ? ' '
+                           : (char) ((random >> 8 & 1 ? UPPER_INT : LOWER_INT) +
+                                     (random >> 16) % ALPHABET);
+      } else if (corpus == 2) {
+         characters[index] = random % 2 == 0
+                           ? punctuation[(random >> 8) % (sizeof(punctuation) - 1)]
+                           : (char) (LOWER_INT + (random >> 16) % ALPHABET);
+      } else if (corpus == 3) {
+         characters[index] = (char) (random >> 24);
+
+      /* Mostly CJK, some emoji and a few ASCII words, as valid UTF-8 throughout       */
+      } else if (random % 10 < 7 && length - index >= 3) {
+         characters[index]   = (char) (0xE4 + (random >> 8) % 6);
+         characters[++index] = (char) (0x80 + (random >> 16) % 64);
+         characters[++index] = (char) (0x80 + (random >> 24) % 64);
+      } else if (random % 10 == 7 && length - index >= 4) {
+         characters[index]   = (char) 0xF0;
+         characters[++index] = (char) 0x9F;
+         characters[++index] = (char) (0x98 + (random >> 8) % 2);
+         characters[++index] = (char) (0x80 + (random >> 16) % 64);
+      } else {
+         characters[index] = random % 4 == 0 ? ' '
+                           : (char) (LOWER_INT + (random >> 16) % ALPHABET);
+      }
+   }
+
+   return;
+}
+
+/* Gives the next number of a fast, repeatable random sequence                         */
+unsigned long long next_random(unsigned long long *seed) {
+   unsigned long long state = *seed; /* Holds the state being stirred                  */
+
+   state ^= state << 13;
+   state ^= state >> 7;
+   state ^= state << 17;
+   *seed  = state;
+
+   return state >> 11;
+}
+
+/* Reads a clock that only ever moves forward, in seconds                              */
+double read_clock() {
+   struct timespec now; /* Holds the time read                                         */
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/* Reads the processor's cycle counter, or 0 where there is none to read               */
+unsigned long long read_cycles() {
+#ifdef X86_CYCLES
+   return __rdtsc();
+#else
+   return 0;
+#endif
+}
+
+/* Gives the clock at the start of a stage, or 0 when the run is not measured          */
+double start_stage() {
+   return stats.enabled ? read_clock() : 0;
+}
+
+/* Adds the time since the start of a stage to that stage                              */
+void   stop_stage(int stage, double started) {
+   if (stats.enabled) {
+      stats.seconds[stage] += read_clock() - started;
+   }
+
+   return;
+}
+
+/* Adds the characters the cipher changed, and the letters among them, to the counts   */
+void   count_characters(const char *characters, size_t length) {
+   unsigned long long counts[ALPHABET] = {0}; /* Holds the count of each letter        */
+   int                letter;                 /* Holds the letter being added up       */
+
+   if (stats.enabled) {
+      cipher_count_frequencies(characters, length, counts);
+      for (letter = 0; letter < ALPHABET; letter++) {
+         stats.letters += counts[letter];
+      }
+      stats.characters += length;
+   }
+
+   return;
+}
+
+/* Reads whether --stats or --stats=FORMAT turns on measuring                          */
+int    read_stats_option(char *option) {
+   if (strcmp(option, "--stats") == 0 || strcmp(option, "--stats=text") == 0) {
+      stats.enabled = 1;
+      stats.json    = 0;
+   } else if (strcmp(option, "--stats=json") == 0) {
+      stats.enabled = 1;
+      stats.json    = 1;
+   } else {
+      return 0;
+   }
+
+   return 1;
+}
+
+/* Prints the measurements of the run to stderr as text or JSON                        */
+void   print_stats() {
+   static const char *names[STAGES] = {"read", "allocate", "cipher", "write", "search",
+                                       "teardown"};
+                                    /* Holds the name of each stage                    */
+   struct rusage     usage;         /* Holds the peak memory of the program            */
+   double            total;         /* Holds the time since the program started        */
+   int               stage;         /* Holds the stage being printed                   */
+
+   if (!stats.enabled) {
+      return;
+   }
+   total = read_clock() - stats.started;
+   getrusage(RUSAGE_SELF, &usage);
+
+   /* Anything printf() is holding goes out first so the report follows it             */
+   fflush(stdout);
+
+   if (stats.json) {
+      fprintf(stderr, "{\"seconds\": %.6f, \"stages\": {", total);
+      for (stage = 0; stage < STAGES; stage++) {
+         fprintf(stderr, "%s\"%s\": %.6f", stage > 0 ? ", " : "", names[stage],
+                 stats.seconds[stage]);
+      }
+      fprintf(stderr, "}, \"characters\": %llu, \"letters\": %llu, "
+                      "\"string_allocations\": %llu, \"string_allocated\": %llu, "
+                      "\"peak_rss_kb\": %ld}\n",
+              stats.characters, stats.letters, stats.allocations, stats.allocated,
+              usage.ru_maxrss);
+   } else {
+      fprintf(stderr, "Total:       %12.6f s\n", total);
+      for (stage = 0; stage < STAGES; stage++) {
+         fprintf(stderr, "%-12s %12.6f s  %5.1f%%\n", names[stage], stats.seconds[stage],
+                 total > 0 ? stats.seconds[stage] * 100 / total : 0);
+      }
+      fprintf(stderr, "Characters:  %12llu\n", stats.characters);
+      fprintf(stderr, "Letters:     %12llu\n", stats.letters);
+      fprintf(stderr, "Strings:     %12llu allocated or enlarged (%llu characters)\n",
+              stats.allocations, stats.allocated);
+      fprintf(stderr, "Peak memory: %12ld KB\n", usage.ru_maxrss);
+   }
+
+   return;
+}
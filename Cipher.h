@@ -0,0 +1,197 @@
+/***************************************************************************************/
+/*                                                                                     */
+/* Cipher Library in C, written by Timothy Powell                                      */
+/*  The ciphers of the cipher program, ready to link into other programs               */
+/*                                                                                     */
+/*     Created: October 16, 2026                                                       */
+/* Last Edited: October 16, 2026                                                       */
+/*                                                                                     */
+/* A cipher is created once from a rotation or a key and can then change any number of */
+/* buffers, from any number of threads at once, without allocating any memory.         */
+/*                                                                                     */
+/* Only the ASCII letters are changed, and only they move a vigenere key along. Every  */
+/* other byte, including every byte of a multibyte UTF-8 character, is copied as it    */
+/* is, whatever the locale or the signedness of char, so UTF-8 text stays valid.       */
+/*                                                                                     */
+/***************************************************************************************/
+
+#ifndef CIPHER_H
+#define CIPHER_H
+
+/***************************************************************************************/
+/*                                      LIBRARIES                                      */
+/***************************************************************************************/
+#include <stddef.h> /* size_t                                                          */
+
+/***************************************************************************************/
+/*                                      CONSTANTS                                      */
+/***************************************************************************************/
+#define CIPHER_MAX_THREADS 256 /* Most threads a buffer is split between               */
+#define CIPHER_ENCRYPT     'e' /* Used to make a stream that encrypts                  */
+#define CIPHER_DECRYPT     'd' /* Used to make a stream that decrypts                  */
+#define CIPHER_ALPHABET    26  /* Number of letters in the alphabet                    */
+#define CIPHER_MAX_CHAIN   1048576 /* Most letters in the key of a chain of ciphers    */
+
+/***************************************************************************************/
+/*                                       STRUCTS                                       */
+/***************************************************************************************/
+/* Struct to hold a cipher ready to change messages; its members are private           */
+typedef struct cipher CIPHER;
+
+/* Struct to hold one message being changed a piece at a time; its members are private */
+typedef struct cipher_stream CIPHER_STREAM;
+
+/* Struct to hold how likely every run of four letters is in English; its members      */
+/* are private                                                                         */
+typedef struct cipher_scorer CIPHER_SCORER;
+
+/* Struct to hold a rotation tried on a caesar ciphertext and how far the letters it   */
+/* gives are from those of English, lower being more likely                            */
+struct cipher_guess {
+   int    rotation; /* Holds the rotation tried, from 0 to 25                          */
+   double score;    /* Holds the chi-squared distance from English letter frequencies, */
+                    /* or the negative quadgram score when ranked by a scorer          */
+};
+typedef struct cipher_guess CIPHER_GUESS;
+
+/* Struct to hold one message of a batch packed into a shared buffer                   */
+struct cipher_record {
+   size_t offset, /* Holds where the message starts in the input and output buffers    */
+          length, /* Holds the number of characters in the message                     */
+          key;    /* Holds the place in the table of ciphers of the one to use         */
+};
+typedef struct cipher_record CIPHER_RECORD;
+
+/***************************************************************************************/
+/*                                FUNCTION DECLARATIONS                                */
+/***************************************************************************************/
+/* Creates a caesar cipher that moves each letter the rotation along the alphabet, or  */
+/* gives NULL with errno set when there is no memory for it                            */
+CIPHER *cipher_create_caesar(int rotation);
+
+/* Creates a vigenere cipher from the letters of a key, skipping anything else, or     */
+/* gives NULL with errno set to EINVAL when the key has no letters                     */
+CIPHER *cipher_create_vigenere(const char *key, size_t length);
+
+/* Creates one cipher with the effect of running several in turn, the first first, so  */
+/* a message is changed in one pass. Their keys are folded into one as long as the     */
+/* least common multiple of their lengths, with every caesar rotation added to each of */
+/* its letters; when every letter comes out the same, the result is a caesar cipher.   */
+/* Gives NULL with errno set to EINVAL when there are no ciphers, E2BIG when the key   */
+/* would be longer than CIPHER_MAX_CHAIN, or ENOMEM.                                   */
+CIPHER *cipher_create_chain(const CIPHER *const *ciphers, size_t count);
+
+/* Sets how many threads large buffers are split between, 0 for one per processor,     */
+/* and gives the number chosen. It must not be called while the cipher is in use.      */
+int    cipher_set_threads(CIPHER *cipher, int threads);
+
+/* Encrypts a buffer from the start of the key; the input and output may be the same   */
+void   cipher_encrypt(const CIPHER *cipher, const char *input, char *output,
+                      size_t length);
+
+/* Decrypts a buffer from the start of the key; the input and output may be the same   */
+void   cipher_decrypt(const CIPHER *cipher, const char *input, char *output,
+                      size_t length);
+
+/* Encrypts a buffer from a position in the key, which is the number of letters        */
+/* already encrypted, and gives the position to carry on from                          */
+size_t cipher_encrypt_from(const CIPHER *cipher, size_t position, const char *input,
+                           char *output, size_t length);
+
+/* Decrypts a buffer from a position in the key, which is the number of letters        */
+/* already decrypted, and gives the position to carry on from                          */
+size_t cipher_decrypt_from(const CIPHER *cipher, size_t position, const char *input,
+                           char *output, size_t length);
+
+/* Gives the letters of the key in lowercase, or an empty string for a caesar cipher   */
+const char *cipher_key(const CIPHER *cipher);
+
+/* Gives the rotation of a caesar cipher from 0 to 25, or 0 for a vigenere cipher      */
+int    cipher_rotation(const CIPHER *cipher);
+
+/* Gives the name of the kernel the cipher runs on this processor                      */
+const char *cipher_kernel_name(const CIPHER *cipher);
+
+/* Checks every kernel this processor can run, and the portable ones, against changing */
+/* a character at a time, over random buffers of many lengths, alignments, rotations   */
+/* and keys, in place and not. Gives NULL when all of them match, or the name of the   */
+/* first that does not.                                                                */
+const char *cipher_check_kernels();
+
+/* Deletes a cipher                                                                    */
+void   cipher_destroy(CIPHER *cipher);
+
+/* Creates a stream that encrypts or decrypts one message with a cipher, which must    */
+/* outlive it, or gives NULL with errno set when there is no memory for it             */
+CIPHER_STREAM *cipher_stream_create(const CIPHER *cipher, char action);
+
+/* Changes the next piece of the stream's message, carrying on in the key from where   */
+/* the last piece stopped, so any split of a message gives the same result as one call */
+void   cipher_stream_update(CIPHER_STREAM *stream, const char *input, char *output,
+                            size_t length);
+
+/* Gives the position in the key the next piece starts from                            */
+size_t cipher_stream_position(const CIPHER_STREAM *stream);
+
+/* Moves the stream to a position in the key, 0 to start a new message                 */
+void   cipher_stream_seek(CIPHER_STREAM *stream, size_t position);
+
+/* Deletes a stream                                                                    */
+void   cipher_stream_destroy(CIPHER_STREAM *stream);
+
+/* Encrypts or decrypts every record of a batch from the start of its own cipher's     */
+/* key, reading each from the input buffer and writing it to the same place in the     */
+/* output buffer, which may be the input. The records are split between threads, 0     */
+/* for one per processor, and nothing is allocated however many there are.             */
+void   cipher_batch(const CIPHER *const *ciphers, const CIPHER_RECORD *records,
+                    size_t count, char action, const char *input, char *output,
+                    int threads);
+
+/* Adds the number of times each letter appears in a buffer to a count per letter, so  */
+/* a message too large to hold can be counted a piece at a time                        */
+void   cipher_count_frequencies(const char *input, size_t length,
+                                unsigned long long counts[CIPHER_ALPHABET]);
+
+/* Scores every rotation of a caesar ciphertext from its letter counts alone and sorts */
+/* them from the most to the least likely                                              */
+void   cipher_rank_rotations(const unsigned long long counts[CIPHER_ALPHABET],
+                             CIPHER_GUESS guesses[CIPHER_ALPHABET]);
+
+/* Finds the most likely key of a vigenere ciphertext, trying every key length up to   */
+/* the longest given and reading no more than the first sample letters, 0 for all.     */
+/* The key's letters are written to key, which needs room for longest + 1 characters,  */
+/* and its length is given, or 0 with errno set when there are too few letters.        */
+size_t cipher_recover_key(const char *input, size_t length, size_t longest,
+                          size_t sample, int threads, char *key);
+
+/* Builds a scorer from the quadgrams of a corpus of English text, or gives NULL with  */
+/* errno set to EINVAL when the corpus has fewer than four letters                     */
+CIPHER_SCORER *cipher_scorer_train(const char *corpus, size_t length);
+
+/* Maps a scorer saved by cipher_scorer_save, or gives NULL with errno set, to EINVAL  */
+/* when the file is not a quadgram table written on a machine like this one            */
+CIPHER_SCORER *cipher_scorer_load(const char *path);
+
+/* Writes a scorer to a file, giving 0, or -1 with errno set when it cannot            */
+int    cipher_scorer_save(const CIPHER_SCORER *scorer, const char *path);
+
+/* Gives the sum of the log probabilities of the quadgrams of a buffer's letters,      */
+/* higher being more like English                                                      */
+double cipher_scorer_score(const CIPHER_SCORER *scorer, const char *input,
+                           size_t length);
+
+/* Scores every rotation of a caesar ciphertext by the quadgrams of the plaintext it   */
+/* gives and sorts them from the most to the least likely                              */
+void   cipher_score_rotations(const CIPHER_SCORER *scorer, const char *input,
+                              size_t length, CIPHER_GUESS guesses[CIPHER_ALPHABET]);
+
+/* Improves a vigenere key of lowercase letters in place by hill-climbing one letter   */
+/* at a time on the quadgram score of the first sample letters, 0 for all, and gives   */
+/* 0, or -1 with errno set to EINVAL when the key is not all lowercase letters         */
+int    cipher_refine_key(const CIPHER_SCORER *scorer, const char *input, size_t length,
+                         size_t sample, char *key);
+
+/* Deletes a scorer                                                                    */
+void   cipher_scorer_destroy(CIPHER_SCORER *scorer);
+
+#endif
@@ -0,0 +1,1893 @@
+/***************************************************************************************/
+/*                                                                                     */
+/* Cipher Library in C, written by Timothy Powell                                      */
+/*  The ciphers of the cipher program, ready to link into other programs               */
+/*                                                                                     */
+/*     Created: October 16, 2026                                                       */
+/* Last Edited: October 16, 2026                                                       */
+/*                                                                                     */
+/* Holds the translation tables, the kernels chosen for the processor, and the engine  */
+/* that splits large buffers between threads. Everything but the functions declared    */
+/* in Cipher.h is private to this file.                                                */
+/*                                                                                     */
+/***************************************************************************************/
+
+/***************************************************************************************/
+/*                                      LIBRARIES                                      */
+/***************************************************************************************/
+#include <ctype.h>    /* tolower()                                                     */
+#include <errno.h>    /* errno                                                         */
+#include <fcntl.h>    /* open()                                                        */
+#include <math.h>     /* log10()                                                       */
+#include <pthread.h>  /* pthread_create(), pthread_join(), pthread_once()              */
+#include <stdlib.h>   /* calloc(), free(), malloc()                                    */
+#include <string.h>   /* memcmp(), memcpy(), memmove()                                 */
+#include <sys/mman.h> /* madvise(), mmap(), munmap()                                   */
+#include <sys/stat.h> /* fstat()                                                       */
+#include <unistd.h>   /* close(), sysconf(), write()                                   */
+#include "Cipher.h"
+
+/* Vector kernels are built whenever the compiler can target x86, and only chosen when */
+/* the processor running the program supports them                                     */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h> /* _mm_*(), _mm256_*()                                          */
+#endif
+
+/***************************************************************************************/
+/*                                      CONSTANTS                                      */
+/***************************************************************************************/
+#define UPPER      'u'      /* Used to determine if a character is upper case          */
+#define LOWER      'l'      /* Used to determine if a character is lower case          */
+#define NEITHER    'n'      /* Used to determine if a character is not a letter        */
+#define LOWER_INT  97       /* Used to make a lowercase letter usable in calculations  */
+#define UPPER_INT  65       /* Used to make an uppercase letter usable in calculations */
+#define ALPHABET   26       /* Number of letters in the alphabet                       */
+#define CHARACTERS 256      /* Number of values a character can hold                   */
+#define KEY_SPILL  32       /* Number of shifts repeated past the end of a key         */
+#define CACHE_LINE 64       /* Number of characters in a cache line                    */
+#define MIN_SHARE  65536    /* Fewest characters worth handing to a thread             */
+#define MIN_COLUMN 8        /* Fewest letters in each column of a key length tried     */
+#define CANDIDATES 4        /* Number of key lengths checked by decrypting with them   */
+#define QUADGRAMS  456976   /* Number of runs of four letters, 26 to the 4th power     */
+#define QUAD_MAGIC "CIPHQUAD" /* Marks the start of a quadgram file                    */
+#define QUAD_FLOOR 0.01     /* Count given to a quadgram the corpus never held         */
+#define CLIMB_GAIN 1e-6     /* Smallest rise in score a key change must make           */
+#define WORD_BYTES 8        /* Number of characters the scalar kernels test at once    */
+#define BYTE_ONES  0x0101010101010101ULL
+                            /* Has a 1 in every byte of a word, to repeat a byte in it */
+#define CHECK_ROUNDS 20000  /* Number of random buffers each kernel is checked on      */
+#define CHECK_SIZE 4096     /* Most characters in a buffer the kernels are checked on  */
+#define CHECK_KEY  64       /* Most letters in a key the kernels are checked with      */
+
+/***************************************************************************************/
+/*                                       STRUCTS                                       */
+/***************************************************************************************/
+/* Struct to hold a caesar rotation or a vigenere key reduced to the shift of each of  */
+/* its letters. A short key is repeated until it is at least KEY_SPILL letters long,   */
+/* so a block of letters can never carry the position more than once around it, and    */
+/* the shifts carry on past the end so a vector kernel can load a whole block of them  */
+/* starting from any letter.                                                           */
+struct cipher {
+   int           shift,          /* Holds the caesar shift, or -1 for a vigenere key   */
+                 threads;        /* Holds the number of threads to split the work into */
+   size_t        period;         /* Holds the number of letters in the repeated key    */
+   char          *letters;       /* Holds the letters of the key in lowercase          */
+   unsigned char *encode_shifts, /* Holds the encoding shift of each letter            */
+                 *decode_shifts; /* Holds the decoding shift of each letter            */
+};
+
+/* Struct to hold the place in the key of a message being changed a piece at a time    */
+struct cipher_stream {
+   const CIPHER *cipher;   /* Points to the cipher changing the message                */
+   char         action;    /* Holds whether the message is encrypted or decrypted      */
+   size_t       position;  /* Holds the place in the key of the next letter            */
+};
+
+/* Struct to hold one thread's share of a buffer being shifted                         */
+struct task {
+   const char          *input;     /* Points to the characters to shift                */
+   char                *output;    /* Points to where the shifted characters go        */
+   size_t              length,     /* Holds the number of characters to shift          */
+                       period,     /* Holds the number of letters in the repeated key  */
+                       position,   /* Holds the place in the key of the first letter   */
+                       letters;    /* Holds the number of letters in the share         */
+   const unsigned char *shifts;    /* Points to the shifts of the key, or NULL         */
+   int                 shift;      /* Holds the shift used when there is no key        */
+};
+typedef struct task TASK;
+
+/* Struct to hold one thread's share of the search for a vigenere key, which is every  */
+/* step-th key length or column starting from the first                                */
+struct search {
+   const unsigned char *letters;      /* Points to the ciphertext's letters, 0 to 25   */
+   size_t              count,         /* Holds the number of letters                   */
+                       first,         /* Holds the first key length or column to try   */
+                       step,          /* Holds the distance to the next one            */
+                       last;          /* Holds the longest key length, or the length   */
+                                      /* whose columns are being solved                */
+   double              *coincidences; /* Holds the index of coincidence of each length */
+   unsigned char       *shifts;       /* Holds the shift found for each column         */
+};
+typedef struct search SEARCH;
+
+/* Struct to hold one thread's share of the records of a batch                         */
+struct batch {
+   const CIPHER *const *ciphers; /* Points to the table of ciphers                     */
+   const CIPHER_RECORD *records; /* Points to the records of the whole batch           */
+   size_t              first,    /* Holds the first record of the share                */
+                       last;     /* Holds the record after the last one of the share   */
+   char                action;   /* Holds whether the records are encrypted            */
+   const char          *input;   /* Points to the packed messages                      */
+   char                *output;  /* Points to where the changed messages go            */
+};
+typedef struct batch BATCH;
+
+/* Struct to hold the table of a quadgram scorer, built in memory or mapped from a     */
+/* file. The table is indexed by the four letters read as a number in base 26.         */
+struct cipher_scorer {
+   const float *table;    /* Points to the log probability of each quadgram            */
+   void        *mapping;  /* Points to the mapped file, or NULL for a built table      */
+   size_t      size;      /* Holds the size of the mapping                             */
+};
+
+/* Struct to hold the start of a quadgram file, which the table directly follows       */
+struct quadgram_header {
+   char         magic[8]; /* Holds QUAD_MAGIC                                          */
+   unsigned int version,  /* Holds the layout of the file, 1                           */
+                count;    /* Holds the number of entries, in the writer's byte order   */
+};
+typedef struct quadgram_header QUADGRAM_HEADER;
+
+/* Struct to hold the letters of a text being hill-climbed and their quadgram score,   */
+/* so a change to some letters only rescores the quadgrams holding them                */
+struct tally {
+   const float   *table;   /* Points to the scorer's table                             */
+   unsigned char *letters; /* Points to the text's letters, 0 to 25                    */
+   size_t        count;    /* Holds the number of letters                              */
+   double        score;    /* Holds the sum of the scores of all the quadgrams         */
+};
+typedef struct tally TALLY;
+
+/***************************************************************************************/
+/*                                  GLOBAL VARIABLES                                   */
+/***************************************************************************************/
+/* Holds, for each shift, what every character becomes; non-letters stay themselves    */
+static unsigned char shift_tables[ALPHABET][CHARACTERS];
+
+/* Holds 1 for each character that is a letter and 0 for the rest                      */
+static unsigned char letter_table[CHARACTERS];
+
+/* Holds how often each letter appears in English text, from 'a' to 'z'                */
+static const double english_frequencies[ALPHABET] = {
+   0.08167, 0.01492, 0.02782, 0.04253, 0.12702, 0.02228, 0.02015, 0.06094, 0.06966,
+   0.00153, 0.00772, 0.04025, 0.02406, 0.06749, 0.07507, 0.01929, 0.00095, 0.05987,
+   0.06327, 0.09056, 0.02758, 0.00978, 0.02360, 0.00150, 0.01974, 0.00074
+};
+
+/* Makes sure the tables are filled and the kernels chosen exactly once                */
+static pthread_once_t set_up_once = PTHREAD_ONCE_INIT;
+
+/* Points to the fastest kernel this processor has for shifting by one amount          */
+static void   (*shift_kernel)(const char *input, char *output, size_t length, int shift);
+
+/* Points to the fastest kernel this processor has for shifting by a key               */
+static size_t (*key_kernel)(const char *input, char *output, size_t length,
+                            const unsigned char *shifts, size_t period, size_t position);
+
+/* Points to the names of the chosen kernels                                           */
+static const char *shift_kernel_name,
+                  *key_kernel_name;
+
+/***************************************************************************************/
+/*                                FUNCTION DECLARATIONS                                */
+/***************************************************************************************/
+/* Fills the tables and chooses the kernels                                            */
+static void   set_up();
+
+/* Tests if a character is uppercase or lowercase                                      */
+static char   test_character(char check);
+
+/* Fills the shift and letter tables                                                   */
+static void   build_tables();
+
+/* Chooses the fastest kernels this processor can run                                  */
+static void   select_kernels();
+
+/* Counts the processors the program can run on                                        */
+static int    count_processors();
+
+/* Counts the letters in a buffer                                                      */
+static size_t count_letters(const char *characters, size_t length);
+
+/* Shifts a buffer by one amount or by a key, splitting it between threads             */
+static size_t parallel_cipher(const char *input, char *output, size_t length, int shift,
+                              const unsigned char *shifts, size_t period,
+                              size_t position, int threads);
+
+/* Runs each task on its own thread, the first on the calling thread                   */
+static void   run_tasks(void *tasks, size_t size, int count, void *(*work)(void *));
+
+/* Counts the letters of a task's share                                                */
+static void   *count_task(void *task);
+
+/* Scores how far the letters counted are from English once moved back by a rotation   */
+static double chi_squared(const unsigned long long counts[ALPHABET], int rotation);
+
+/* Counts the letters of one column of the ciphertext under a key length               */
+static void   count_column(const unsigned char *letters, size_t count, size_t column,
+                           size_t length, unsigned long long counts[CIPHER_ALPHABET]);
+
+/* Splits the key lengths or columns of a search between threads and runs them         */
+static void   run_search(const unsigned char *letters, size_t count, size_t last,
+                         double *coincidences, unsigned char *shifts, int threads,
+                         void *(*work)(void *));
+
+/* Finds the index of coincidence of a search's share of the key lengths               */
+static void   *coincidence_task(void *task);
+
+/* Finds the shift of each of a search's share of the columns                          */
+static void   *column_task(void *task);
+
+/* Shifts a task's share                                                               */
+static void   *shift_task(void *task);
+
+/* Changes each record of a batch's share with its own cipher                          */
+static void   *batch_task(void *task);
+
+/* Sorts guesses by score, keeping ties in order of rotation                           */
+static void   sort_guesses(CIPHER_GUESS guesses[CIPHER_ALPHABET]);
+
+/* Writes a whole buffer to a file descriptor, however many calls it takes             */
+static int    write_whole(int file, const void *data, size_t length);
+
+/* Sums the scores of the quadgrams holding any letter of a column, each once          */
+static double score_column(const TALLY *tally, size_t first, size_t step);
+
+/* Moves every letter of a column the same amount along the alphabet                   */
+static void   move_column(TALLY *tally, size_t first, size_t step, int delta);
+
+/* Gives a word with the top bit set of each of its bytes that is an ASCII letter      */
+static unsigned long long letter_bits(unsigned long long word);
+
+/* Copies the words at the start of a buffer that hold no letters, and gives how many  */
+/* characters were copied                                                              */
+static size_t skip_plain(const char *input, char *output, size_t length);
+
+/* Gives the next number of the generator the kernel check fills its buffers from      */
+static unsigned long long check_random(unsigned long long *seed);
+
+/* Fills a buffer for the kernel check with runs of letters, of ASCII that is not a    */
+/* letter, of bytes with the top bit set and of any byte at all                        */
+static void   fill_check(char *buffer, size_t length, unsigned long long *seed);
+
+/* Shifts every letter of a buffer by one amount, a character at a time                */
+static void   shift_scalar(const char *input, char *output, size_t length, int shift);
+
+/* Shifts the letters of a buffer by a key, a character at a time                      */
+static size_t key_scalar(const char *input, char *output, size_t length,
+                         const unsigned char *shifts, size_t period, size_t position);
+
+#ifdef X86_KERNELS
+/* Shifts every letter of a buffer by one amount, 16 characters at a time              */
+static void   shift_sse2(const char *input, char *output, size_t length, int shift);
+
+/* Shifts every letter of a buffer by one amount, 32 characters at a time              */
+static void   shift_avx2(const char *input, char *output, size_t length, int shift);
+
+/* Shifts the letters of a buffer by a key, 16 characters at a time                    */
+static size_t key_ssse3(const char *input, char *output, size_t length,
+                        const unsigned char *shifts, size_t period, size_t position);
+
+/* Shifts the letters of a buffer by a key, 32 characters at a time                    */
+static size_t key_avx2(const char *input, char *output, size_t length,
+                       const unsigned char *shifts, size_t period, size_t position);
+#endif
+
+/***************************************************************************************/
+/*                                 FUNCTION DEFINITIONS                                */
+/***************************************************************************************/
+/* Creates a caesar cipher that moves each letter the rotation along the alphabet      */
+CIPHER *cipher_create_caesar(int rotation) {
+   CIPHER *cipher; /* Points to the new cipher                                         */
+
+   pthread_once(&set_up_once, set_up);
+   if ((cipher = (CIPHER *) malloc(sizeof(CIPHER))) == NULL) {
+      return NULL;
+   }
+   cipher->shift         = (rotation % ALPHABET + ALPHABET) % ALPHABET;
+   cipher->threads       = 1;
+   cipher->period        = 0;
+   cipher->letters       = NULL;
+   cipher->encode_shifts = NULL;
+   cipher->decode_shifts = NULL;
+
+   return cipher;
+}
+
+/* Creates a vigenere cipher from the letters of a key, skipping anything else         */
+CIPHER *cipher_create_vigenere(const char *key, size_t length) {
+   CIPHER *cipher;      /* Points to the new cipher                                    */
+   size_t letters = 0,  /* Holds the number of letters in the key                      */
+          index;        /* Holds the character of the key being read                   */
+   int    shift;        /* Holds the shift of the letter being added                   */
+
+   pthread_once(&set_up_once, set_up);
+   for (index = 0; index < length; index++) {
+      letters += test_character(key[index]) != NEITHER;
+   }
+   if (letters == 0) {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   /* Create the cipher with room for the repeated key and the shifts past its end     */
+   if ((cipher = (CIPHER *) malloc(sizeof(CIPHER))) == NULL) {
+      return NULL;
+   }
+   cipher->shift   = -1;
+   cipher->threads = 1;
+   cipher->period  = letters;
+   while (cipher->period < KEY_SPILL) {
+      cipher->period += letters;
+   }
+   cipher->letters       = (char *) malloc(letters + 1);
+   cipher->encode_shifts = (unsigned char *) malloc(cipher->period + KEY_SPILL);
+   cipher->decode_shifts = (unsigned char *) malloc(cipher->period + KEY_SPILL);
+   if (cipher->letters == NULL || cipher->encode_shifts == NULL ||
+       cipher->decode_shifts == NULL) {
+      cipher_destroy(cipher);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   /* Take the shift of each letter, skipping anything not a letter                    */
+   letters = 0;
+   for (index = 0; index < length; index++) {
+      if (test_character(key[index]) != NEITHER) {
+         cipher->letters[letters]       = (char) tolower((unsigned char) key[index]);
+         shift                          = cipher->letters[letters] - LOWER_INT;
+         cipher->encode_shifts[letters] = (unsigned char) shift;
+         cipher->decode_shifts[letters] = (unsigned char) (ALPHABET - shift) % ALPHABET;
+         letters++;
+      }
+   }
+   cipher->letters[letters] = '\0';
+
+   /* Repeat the shifts through the rest of the period and past its end                */
+   for (index = letters; index < cipher->period + KEY_SPILL; index++) {
+      cipher->encode_shifts[index] = cipher->encode_shifts[index - letters];
+      cipher->decode_shifts[index] = cipher->decode_shifts[index - letters];
+   }
+
+   return cipher;
+}
+
+/* Creates one cipher with the effect of several run in turn by folding their keys     */
+CIPHER *cipher_create_chain(const CIPHER *const *ciphers, size_t count) {
+   CIPHER *cipher;      /* Points to the new cipher                                    */
+   char   *key;         /* Points to the letters of the folded key                     */
+   size_t period = 1,   /* Holds the length of the folded key                          */
+          length,       /* Holds the length of the key of the cipher being folded in   */
+          divisor,      /* Holds the greatest common divisor being found               */
+          remainder,    /* Holds the remainder of a step of Euclid's algorithm         */
+          stage,        /* Holds the cipher being folded in                            */
+          index;        /* Holds the letter of the folded key being changed            */
+   int    same = 1;     /* Holds whether every letter of the folded key is the same    */
+
+   if (count == 0) {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   /* The folded key repeats after the least common multiple of the key lengths        */
+   for (stage = 0; stage < count; stage++) {
+      length  = ciphers[stage]->shift >= 0 ? 1 : strlen(ciphers[stage]->letters);
+      divisor = period;
+      for (remainder = length; remainder != 0; ) {
+         index     = divisor % remainder;
+         divisor   = remainder;
+         remainder = index;
+      }
+      if (period / divisor > CIPHER_MAX_CHAIN / length) {
+         errno = E2BIG;
+         return NULL;
+      }
+      period = period / divisor * length;
+   }
+
+   /* Add up the shift every cipher gives each letter of the folded key                */
+   if ((key = (char *) calloc(period + 1, 1)) == NULL) {
+      return NULL;
+   }
+   for (stage = 0; stage < count; stage++) {
+      if (ciphers[stage]->shift >= 0) {
+         for (index = 0; index < period; index++) {
+            key[index] = (char) ((key[index] + ciphers[stage]->shift) % ALPHABET);
+         }
+      } else {
+         length = strlen(ciphers[stage]->letters);
+         for (index = 0; index < period; index++) {
+            key[index] = (char) ((key[index] + ciphers[stage]->letters[index % length] -
+                                  LOWER_INT) % ALPHABET);
+         }
+      }
+   }
+   for (index = 0; index < period; index++) {
+      same      &= key[index] == key[0];
+      key[index] = (char) (key[index] + LOWER_INT);
+   }
+
+   /* A key of one repeated letter is a rotation, which runs on the faster kernels     */
+   cipher = same ? cipher_create_caesar(key[0] - LOWER_INT)
+                 : cipher_create_vigenere(key, period);
+   free(key);
+
+   return cipher;
+}
+
+/* Sets how many threads large buffers are split between, 0 for one per processor      */
+int    cipher_set_threads(CIPHER *cipher, int threads) {
+   if (threads <= 0) {
+      threads = count_processors();
+   } else if (threads > CIPHER_MAX_THREADS) {
+      threads = CIPHER_MAX_THREADS;
+   }
+   cipher->threads = threads;
+
+   return threads;
+}
+
+/* Encrypts a buffer from the start of the key                                         */
+void   cipher_encrypt(const CIPHER *cipher, const char *input, char *output,
+                      size_t length) {
+   cipher_encrypt_from(cipher, 0, input, output, length);
+
+   return;
+}
+
+/* Decrypts a buffer from the start of the key                                         */
+void   cipher_decrypt(const CIPHER *cipher, const char *input, char *output,
+                      size_t length) {
+   cipher_decrypt_from(cipher, 0, input, output, length);
+
+   return;
+}
+
+/* Encrypts a buffer from a position in the key, giving the position to carry on from  */
+size_t cipher_encrypt_from(const CIPHER *cipher, size_t position, const char *input,
+                           char *output, size_t length) {
+   if (cipher->shift >= 0) {
+      parallel_cipher(input, output, length, cipher->shift, NULL, 0, 0, cipher->threads);
+      return position;
+   }
+
+   return parallel_cipher(input, output, length, 0, cipher->encode_shifts,
+                          cipher->period, position % cipher->period, cipher->threads);
+}
+
+/* Decrypts a buffer from a position in the key, giving the position to carry on from  */
+size_t cipher_decrypt_from(const CIPHER *cipher, size_t position, const char *input,
+                           char *output, size_t length) {
+   if (cipher->shift >= 0) {
+      parallel_cipher(input, output, length, (ALPHABET - cipher->shift) % ALPHABET,
+                      NULL, 0, 0, cipher->threads);
+      return position;
+   }
+
+   return parallel_cipher(input, output, length, 0, cipher->decode_shifts,
+                          cipher->period, position % cipher->period, cipher->threads);
+}
+
+/* Gives the letters of the key in lowercase, or an empty string for a caesar cipher   */
+const char *cipher_key(const CIPHER *cipher) {
+   return cipher->letters == NULL ? "" : cipher->letters;
+}
+
+/* Gives the rotation of a caesar cipher from 0 to 25, or 0 for a vigenere cipher      */
+int    cipher_rotation(const CIPHER *cipher) {
+   return cipher->shift >= 0 ? cipher->shift : 0;
+}
+
+/* Gives the name of the kernel the cipher runs on this processor                      */
+const char *cipher_kernel_name(const CIPHER *cipher) {
+   if (cipher->shift == 0) {
+      return "copy";
+   }
+   return cipher->shift >= 0 ? shift_kernel_name : key_kernel_name;
+}
+
+/* Checks every kernel this processor can run against changing a character at a time   */
+const char *cipher_check_kernels() {
+   void          (*shifters[3])(const char *input, char *output, size_t length,
+                                int shift);      /* Points to each shift kernel        */
+   size_t        (*keyers[3])(const char *input, char *output, size_t length,
+                              const unsigned char *shifts, size_t period,
+                              size_t position);  /* Points to each key kernel          */
+   const char    *shift_names[3],                /* Points to each shift kernel's name */
+                 *key_names[3];                  /* Points to each key kernel's name   */
+   char          input[CHECK_SIZE + CACHE_LINE], /* Holds the characters to change     */
+                 expected[CHECK_SIZE],           /* Holds them changed one at a time   */
+                 output[CHECK_SIZE + CACHE_LINE + 1];
+                                                 /* Holds them changed by a kernel     */
+   unsigned char shifts[CHECK_KEY * 2 + KEY_SPILL];
+                                                 /* Holds the shifts of a random key   */
+   unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+                                                 /* Holds the state of the generator   */
+   size_t        length,                         /* Holds the characters changed       */
+                 letters,                        /* Holds the letters in the key       */
+                 period,                         /* Holds the repeated key's length    */
+                 start,                          /* Holds the key position to start at */
+                 position,                       /* Holds the key position carried on  */
+                 index;                          /* Holds the character being changed  */
+   int           shifter_count = 0,              /* Holds the number of shift kernels  */
+                 keyer_count = 0,                /* Holds the number of key kernels    */
+                 round,                          /* Holds the round being checked      */
+                 kernel,                         /* Holds the kernel being checked     */
+                 shift;                          /* Holds the rotation of the round    */
+   char          *from,                          /* Points to where a kernel reads     */
+                 *to;                            /* Points to where a kernel writes    */
+
+   pthread_once(&set_up_once, set_up);
+   shifters[shifter_count]      = shift_scalar;
+   shift_names[shifter_count++] = "shift_scalar";
+   keyers[keyer_count]          = key_scalar;
+   key_names[keyer_count++]     = "key_scalar";
+#ifdef X86_KERNELS
+   if (__builtin_cpu_supports("sse2")) {
+      shifters[shifter_count]      = shift_sse2;
+      shift_names[shifter_count++] = "shift_sse2";
+   }
+   if (__builtin_cpu_supports("ssse3")) {
+      keyers[keyer_count]      = key_ssse3;
+      key_names[keyer_count++] = "key_ssse3";
+   }
+   if (__builtin_cpu_supports("avx2")) {
+      shifters[shifter_count]      = shift_avx2;
+      shift_names[shifter_count++] = "shift_avx2";
+      keyers[keyer_count]          = key_avx2;
+      key_names[keyer_count++]     = "key_avx2";
+   }
+#endif
+
+   for (round = 0; round < CHECK_ROUNDS; round++) {
+      /* Pick a length, the alignments of the input and output, and a random key       */
+      length = (size_t) (check_random(&seed) % (CHECK_SIZE + 1));
+      from   = input + check_random(&seed) % CACHE_LINE;
+      to     = output + check_random(&seed) % CACHE_LINE;
+      fill_check(from, length, &seed);
+      shift   = (int) (check_random(&seed) % ALPHABET);
+      letters = 1 + (size_t) (check_random(&seed) % CHECK_KEY);
+      for (period = letters; period < KEY_SPILL; period += letters) {
+      }
+      for (index = 0; index < period + KEY_SPILL; index++) {
+         shifts[index] = index < letters
+                            ? (unsigned char) (check_random(&seed) % ALPHABET)
+                            : shifts[index - letters];
+      }
+      start = (size_t) (check_random(&seed) % period);
+
+      /* Every shift kernel must match the shift tables, in place on odd rounds        */
+      for (index = 0; index < length; index++) {
+         expected[index] = (char) shift_tables[shift][(unsigned char) from[index]];
+      }
+      for (kernel = 0; kernel < shifter_count; kernel++) {
+         memcpy(to, from, length);
+         to[length] = '#';
+         shifters[kernel](round % 2 ? to : from, to, length, shift);
+         if (memcmp(to, expected, length) != 0 || to[length] != '#') {
+            return shift_names[kernel];
+         }
+      }
+
+      /* Every key kernel must match them too, and carry on from the same position     */
+      position = start;
+      for (index = 0; index < length; index++) {
+         shift            = shifts[position];
+         expected[index]  = (char) shift_tables[shift][(unsigned char) from[index]];
+         position        += letter_table[(unsigned char) from[index]];
+         position         = position == period ? 0 : position;
+      }
+      for (kernel = 0; kernel < keyer_count; kernel++) {
+         memcpy(to, from, length);
+         to[length] = '#';
+         if (keyers[kernel](round % 2 ? to : from, to, length, shifts, period, start) !=
+             position || memcmp(to, expected, length) != 0 || to[length] != '#') {
+            return key_names[kernel];
+         }
+      }
+   }
+
+   return NULL;
+}
+
+/* Deletes a cipher                                                                    */
+void   cipher_destroy(CIPHER *cipher) {
+   if (cipher != NULL) {
+      free(cipher->letters);
+      free(cipher->encode_shifts);
+      free(cipher->decode_shifts);
+      free(cipher);
+   }
+
+   return;
+}
+
+/* Creates a stream that encrypts or decrypts one message with a cipher                */
+CIPHER_STREAM *cipher_stream_create(const CIPHER *cipher, char action) {
+   CIPHER_STREAM *stream; /* Points to the new stream                                  */
+
+   if ((stream = (CIPHER_STREAM *) malloc(sizeof(CIPHER_STREAM))) == NULL) {
+      return NULL;
+   }
+   stream->cipher   = cipher;
+   stream->action   = action;
+   stream->position = 0;
+
+   return stream;
+}
+
+/* Changes the next piece of the stream's message, carrying on in the key              */
+void   cipher_stream_update(CIPHER_STREAM *stream, const char *input, char *output,
+                            size_t length) {
+   if (stream->action == CIPHER_ENCRYPT) {
+      stream->position = cipher_encrypt_from(stream->cipher, stream->position,
+                                             input, output, length);
+   } else {
+      stream->position = cipher_decrypt_from(stream->cipher, stream->position,
+                                             input, output, length);
+   }
+
+   return;
+}
+
+/* Gives the position in the key the next piece starts from                            */
+size_t cipher_stream_position(const CIPHER_STREAM *stream) {
+   return stream->position;
+}
+
+/* Moves the stream to a position in the key                                           */
+void   cipher_stream_seek(CIPHER_STREAM *stream, size_t position) {
+   stream->position = stream->cipher->shift >= 0 ? 0 : position % stream->cipher->period;
+
+   return;
+}
+
+/* Deletes a stream                                                                    */
+void   cipher_stream_destroy(CIPHER_STREAM *stream) {
+   free(stream);
+
+   return;
+}
+
+/* Encrypts or decrypts every record of a batch with its own cipher                    */
+/* The records are split into runs of about the same number of characters, one per     */
+/* thread, and each record goes straight to the chosen kernel with the shifts its      */
+/* cipher already holds, so a record costs no more than a kernel call.                 */
+void   cipher_batch(const CIPHER *const *ciphers, const CIPHER_RECORD *records,
+                    size_t count, char action, const char *input, char *output,
+                    int threads) {
+   BATCH  batches[CIPHER_MAX_THREADS]; /* Holds each thread's share of the records     */
+   size_t total = 0,                   /* Holds the characters not yet given a share   */
+          taken = 0,                   /* Holds the characters of the open share       */
+          index;                       /* Holds the record being counted               */
+   int    parts = 0;                   /* Holds the number of shares closed            */
+
+   if (threads <= 0) {
+      threads = count_processors();
+   } else if (threads > CIPHER_MAX_THREADS) {
+      threads = CIPHER_MAX_THREADS;
+   }
+   for (index = 0; index < count; index++) {
+      total += records[index].length;
+   }
+   if ((size_t) threads > total / MIN_SHARE) {
+      threads = (int) (total / MIN_SHARE);
+   }
+
+   /* Close a share once it holds its part of what is left, so the shares even out     */
+   batches[0].first = 0;
+   for (index = 0; index < count && parts < threads - 1; index++) {
+      taken += records[index].length;
+      if (taken * (size_t) (threads - parts) >= total) {
+         batches[parts].last    = index + 1;
+         batches[++parts].first = index + 1;
+         total                 -= taken;
+         taken                  = 0;
+      }
+   }
+   batches[parts++].last = count;
+   for (index = 0; index < (size_t) parts; index++) {
+      batches[index].ciphers = ciphers;
+      batches[index].records = records;
+      batches[index].action  = action;
+      batches[index].input   = input;
+      batches[index].output  = output;
+   }
+   run_tasks(batches, sizeof(BATCH), parts, batch_task);
+
+   return;
+}
+
+/* Adds the number of times each letter appears in a buffer to a count per letter      */
+/* Every character is counted into one of four tables in turn, so a run of the same    */
+/* character does not wait on the count it just wrote, and the letters are picked out  */
+/* of the tables once at the end.                                                      */
+void   cipher_count_frequencies(const char *input, size_t length,
+                                unsigned long long counts[CIPHER_ALPHABET]) {
+   size_t tallies[4][CHARACTERS] = {{0}}; /* Holds the count of each character         */
+   size_t index;                          /* Holds the character's place               */
+   int    letter;                         /* Holds the letter being picked out         */
+
+   for (index = 0; index + 4 <= length; index += 4) {
+      tallies[0][(unsigned char) input[index]]++;
+      tallies[1][(unsigned char) input[index + 1]]++;
+      tallies[2][(unsigned char) input[index + 2]]++;
+      tallies[3][(unsigned char) input[index + 3]]++;
+   }
+   for (; index < length; index++) {
+      tallies[0][(unsigned char) input[index]]++;
+   }
+
+   for (letter = 0; letter < ALPHABET; letter++) {
+      counts[letter] += tallies[0][LOWER_INT + letter] + tallies[0][UPPER_INT + letter] +
+                        tallies[1][LOWER_INT + letter] + tallies[1][UPPER_INT + letter] +
+                        tallies[2][LOWER_INT + letter] + tallies[2][UPPER_INT + letter] +
+                        tallies[3][LOWER_INT + letter] + tallies[3][UPPER_INT + letter];
+   }
+
+   return;
+}
+
+/* Scores every rotation of a caesar ciphertext from its letter counts alone and sorts */
+/* them from the most to the least likely                                              */
+void   cipher_rank_rotations(const unsigned long long counts[CIPHER_ALPHABET],
+                             CIPHER_GUESS guesses[CIPHER_ALPHABET]) {
+   int rotation; /* Holds the rotation being scored                                    */
+
+   for (rotation = 0; rotation < ALPHABET; rotation++) {
+      guesses[rotation].rotation = rotation;
+      guesses[rotation].score    = chi_squared(counts, rotation);
+   }
+   sort_guesses(guesses);
+
+   return;
+}
+
+/* Finds the most likely key of a vigenere ciphertext                                  */
+/* The letters are taken once into a compact buffer. The index of coincidence of every */
+/* key length is found from it, the lengths split between threads, and each column of  */
+/* the most promising lengths is solved on its own as a caesar cipher. Each key found  */
+/* is then checked by decrypting the text with it, keeping the one that reads most     */
+/* like English, so a multiple of the true length cannot win.                          */
+size_t cipher_recover_key(const char *input, size_t length, size_t longest,
+                          size_t sample, int threads, char *key) {
+   unsigned long long counts[ALPHABET];   /* Holds the letters of a decryption         */
+   unsigned char      *letters,           /* Points to the ciphertext's letters        */
+                      *shifts;            /* Points to the shift of each column        */
+   double             *coincidences,      /* Points to the index of each key length    */
+                      score,              /* Holds how unlike English a decryption is  */
+                      best_score = 0;     /* Holds the score of the best key so far    */
+   char               *candidate,         /* Points to the key being checked           */
+                      *plaintext;         /* Points to the text decrypted with it      */
+   CIPHER             *cipher;            /* Points to the cipher made from the key    */
+   size_t             count = 0,          /* Holds the number of letters taken         */
+                      best_length = 0,    /* Holds the length of the best key so far   */
+                      key_length,         /* Holds the key length being checked        */
+                      period,             /* Holds the length the key repeats after    */
+                      index;              /* Holds the character or length being read  */
+   int                tried;              /* Holds the number of key lengths checked   */
+
+   pthread_once(&set_up_once, set_up);
+
+   /* Take the letters, up to the sample, as their places in the alphabet              */
+   if (sample == 0 || sample > length) {
+      sample = length;
+   }
+   if ((letters = (unsigned char *) malloc(sample + 1)) == NULL) {
+      return 0;
+   }
+   for (index = 0; index < length && count < sample; index++) {
+      if (letter_table[(unsigned char) input[index]]) {
+         letters[count++] = (unsigned char) ((input[index] | 0x20) - LOWER_INT);
+      }
+   }
+   length = index;
+
+   /* Only try key lengths that leave enough letters in every column                   */
+   if (longest > count / MIN_COLUMN) {
+      longest = count / MIN_COLUMN;
+   }
+   if (longest == 0) {
+      free(letters);
+      errno = EINVAL;
+      return 0;
+   }
+   coincidences = (double *) malloc((longest + 1) * sizeof(double));
+   shifts       = (unsigned char *) malloc(longest);
+   candidate    = (char *) malloc(longest + 1);
+   plaintext    = (char *) malloc(length);
+   if (coincidences == NULL || shifts == NULL || candidate == NULL ||
+       plaintext == NULL) {
+      free(letters);
+      free(coincidences);
+      free(shifts);
+      free(candidate);
+      free(plaintext);
+      errno = ENOMEM;
+      return 0;
+   }
+   if (threads <= 0) {
+      threads = count_processors();
+   }
+
+   /* Find the index of coincidence of every key length at once                        */
+   coincidences[0] = -1;
+   run_search(letters, count, longest, coincidences, NULL, threads, coincidence_task);
+
+   /* Solve the columns of the likeliest lengths and check each key by decrypting      */
+   for (tried = 0; tried < CANDIDATES; tried++) {
+      key_length = 0;
+      for (index = 1; index <= longest; index++) {
+         if (coincidences[index] > coincidences[key_length]) {
+            key_length = index;
+         }
+      }
+      if (key_length == 0) {
+         break;
+      }
+      coincidences[key_length] = -1;
+      run_search(letters, count, key_length, NULL, shifts, threads, column_task);
+
+      /* A key that repeats itself is only as long as the part repeated                */
+      for (period = 1; period < key_length; period++) {
+         for (index = period;
+              index < key_length && shifts[index] == shifts[index - period]; index++) {
+         }
+         if (key_length % period == 0 && index == key_length) {
+            break;
+         }
+      }
+      for (index = 0; index < period; index++) {
+         candidate[index] = (char) (LOWER_INT + shifts[index]);
+      }
+      candidate[period] = '\0';
+
+      if ((cipher = cipher_create_vigenere(candidate, period)) == NULL) {
+         break;
+      }
+      cipher_decrypt(cipher, input, plaintext, length);
+      cipher_destroy(cipher);
+      for (index = 0; index < ALPHABET; index++) {
+         counts[index] = 0;
+      }
+      cipher_count_frequencies(plaintext, length, counts);
+      score = chi_squared(counts, 0);
+      if (best_length == 0 || score < best_score ||
+          (score == best_score && period < best_length)) {
+         best_score  = score;
+         best_length = period;
+         for (index = 0; index <= period; index++) {
+            key[index] = candidate[index];
+         }
+      }
+   }
+
+   free(letters);
+   free(coincidences);
+   free(shifts);
+   free(candidate);
+   free(plaintext);
+
+   return best_length;
+}
+
+/* Builds a scorer from the quadgrams of a corpus of English text                      */
+/* Non-letters are skipped, so a quadgram can span a space or a line break, the same   */
+/* way the letters of a ciphertext are read when it is scored.                         */
+CIPHER_SCORER *cipher_scorer_train(const char *corpus, size_t length) {
+   CIPHER_SCORER *scorer;        /* Points to the new scorer                           */
+   unsigned int  *counts;        /* Points to the count of each quadgram               */
+   float         *table;         /* Points to the log probability of each quadgram     */
+   double        total,          /* Holds the number of quadgrams counted              */
+                 unseen;         /* Holds the score of a quadgram never counted        */
+   size_t        quadgram = 0,   /* Holds the last four letters read, in base 26       */
+                 letters  = 0,   /* Holds the number of letters read                   */
+                 index;          /* Holds the character or quadgram being read         */
+
+   pthread_once(&set_up_once, set_up);
+   scorer = (CIPHER_SCORER *) malloc(sizeof(CIPHER_SCORER));
+   counts = (unsigned int *) calloc(QUADGRAMS, sizeof(unsigned int));
+   table  = (float *) malloc(QUADGRAMS * sizeof(float));
+   if (scorer == NULL || counts == NULL || table == NULL) {
+      free(scorer);
+      free(counts);
+      free(table);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   /* Count each run of four letters as the window rolls over the corpus               */
+   for (index = 0; index < length; index++) {
+      if (letter_table[(unsigned char) corpus[index]]) {
+         quadgram  = quadgram * ALPHABET + (size_t) ((corpus[index] | 0x20) - LOWER_INT);
+         quadgram %= QUADGRAMS;
+         if (++letters >= 4) {
+            counts[quadgram]++;
+         }
+      }
+   }
+   if (letters < 4) {
+      free(scorer);
+      free(counts);
+      free(table);
+      errno = EINVAL;
+      return NULL;
+   }
+
+   /* Turn the counts into log probabilities, giving the unseen ones a small floor     */
+   total  = (double) (letters - 3);
+   unseen = log10(QUAD_FLOOR / total);
+   for (index = 0; index < QUADGRAMS; index++) {
+      table[index] = (float) (counts[index] > 0 ? log10(counts[index] / total) : unseen);
+   }
+   free(counts);
+
+   scorer->table   = table;
+   scorer->mapping = NULL;
+   scorer->size    = 0;
+
+   return scorer;
+}
+
+/* Maps a scorer saved by cipher_scorer_save                                           */
+/* The table is used straight from the mapping, so loading costs no reading or parsing */
+/* and processes sharing a table share its pages.                                      */
+CIPHER_SCORER *cipher_scorer_load(const char *path) {
+   CIPHER_SCORER   *scorer;  /* Points to the new scorer                               */
+   QUADGRAM_HEADER *header;  /* Points to the start of the mapped file                 */
+   struct stat     status;   /* Holds the size of the file                             */
+   void            *mapping; /* Points to the mapped file                              */
+   size_t          size = sizeof(QUADGRAM_HEADER) + QUADGRAMS * sizeof(float);
+                             /* Holds the size the file must have                      */
+   int             file,     /* Holds the descriptor of the file                       */
+                   error;    /* Holds the error from mapping the file                  */
+
+   pthread_once(&set_up_once, set_up);
+   if ((file = open(path, O_RDONLY)) < 0) {
+      return NULL;
+   }
+   if (fstat(file, &status) != 0) {
+      error = errno;
+      close(file);
+      errno = error;
+      return NULL;
+   }
+   if ((size_t) status.st_size != size) {
+      close(file);
+      errno = EINVAL;
+      return NULL;
+   }
+   mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+   error   = errno;
+   close(file);
+   if (mapping == MAP_FAILED) {
+      errno = error;
+      return NULL;
+   }
+
+   /* Make sure the file holds a table laid out the way this machine reads it          */
+   header = (QUADGRAM_HEADER *) mapping;
+   if (memcmp(header->magic, QUAD_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != 1 || header->count != QUADGRAMS) {
+      munmap(mapping, size);
+      errno = EINVAL;
+      return NULL;
+   }
+   if ((scorer = (CIPHER_SCORER *) malloc(sizeof(CIPHER_SCORER))) == NULL) {
+      munmap(mapping, size);
+      errno = ENOMEM;
+      return NULL;
+   }
+   madvise(mapping, size, MADV_WILLNEED);
+
+   scorer->table   = (const float *) (header + 1);
+   scorer->mapping = mapping;
+   scorer->size    = size;
+
+   return scorer;
+}
+
+/* Writes a scorer to a file                                                           */
+int    cipher_scorer_save(const CIPHER_SCORER *scorer, const char *path) {
+   QUADGRAM_HEADER header; /* Holds the start of the file                              */
+   int             file,   /* Holds the descriptor of the file                         */
+                   saved,  /* Holds whether everything was written                     */
+                   error;  /* Holds the error from writing the file                    */
+
+   memcpy(header.magic, QUAD_MAGIC, sizeof(header.magic));
+   header.version = 1;
+   header.count   = QUADGRAMS;
+
+   if ((file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+      return -1;
+   }
+   saved = write_whole(file, &header, sizeof(header)) &&
+           write_whole(file, scorer->table, QUADGRAMS * sizeof(float));
+   error = errno;
+
+   /* Closing the file is where a failed write can first show up                       */
+   if (close(file) != 0 && saved) {
+      return -1;
+   }
+   errno = error;
+
+   return saved ? 0 : -1;
+}
+
+/* Gives the sum of the log probabilities of the quadgrams of a buffer's letters       */
+double cipher_scorer_score(const CIPHER_SCORER *scorer, const char *input,
+                           size_t length) {
+   double score    = 0; /* Holds the sum of the quadgrams' scores                      */
+   size_t quadgram = 0, /* Holds the last four letters read, in base 26                */
+          letters  = 0, /* Holds the number of letters read                            */
+          index;        /* Holds the character's place                                 */
+
+   for (index = 0; index < length; index++) {
+      if (letter_table[(unsigned char) input[index]]) {
+         quadgram  = quadgram * ALPHABET + (size_t) ((input[index] | 0x20) - LOWER_INT);
+         quadgram %= QUADGRAMS;
+         if (++letters >= 4) {
+            score += scorer->table[quadgram];
+         }
+      }
+   }
+
+   return score;
+}
+
+/* Scores every rotation of a caesar ciphertext by the quadgrams of its plaintext      */
+void   cipher_score_rotations(const CIPHER_SCORER *scorer, const char *input,
+                              size_t length, CIPHER_GUESS guesses[CIPHER_ALPHABET]) {
+   double score;    /* Holds the sum of the quadgrams' scores                          */
+   size_t quadgram, /* Holds the last four letters read, in base 26                    */
+          letters,  /* Holds the number of letters read                                */
+          index;    /* Holds the character's place                                     */
+   int    rotation; /* Holds the rotation being scored                                 */
+
+   pthread_once(&set_up_once, set_up);
+   for (rotation = 0; rotation < ALPHABET; rotation++) {
+      score    = 0;
+      quadgram = 0;
+      letters  = 0;
+      for (index = 0; index < length; index++) {
+         if (letter_table[(unsigned char) input[index]]) {
+            quadgram  = quadgram * ALPHABET +
+                        (size_t) ((input[index] | 0x20) - LOWER_INT + ALPHABET -
+                                  rotation) % ALPHABET;
+            quadgram %= QUADGRAMS;
+            if (++letters >= 4) {
+               score += scorer->table[quadgram];
+            }
+         }
+      }
+      guesses[rotation].rotation = rotation;
+      guesses[rotation].score    = -score;
+   }
+   sort_guesses(guesses);
+
+   return;
+}
+
+/* Improves a vigenere key in place by hill-climbing on the quadgram score             */
+/* The sample is decrypted once into a compact buffer. Each letter of the key is then  */
+/* tried at every value by moving its column of the plaintext one letter at a time,    */
+/* and only the quadgrams holding that column are rescored after each move. The best   */
+/* value is kept, and the passes over the key repeat until none of it changes.         */
+int    cipher_refine_key(const CIPHER_SCORER *scorer, const char *input, size_t length,
+                         size_t sample, char *key) {
+   TALLY  tally;        /* Holds the plaintext and its score                           */
+   double rest,         /* Holds the score of the quadgrams outside the column         */
+          score,        /* Holds the score with the column moved                       */
+          best;         /* Holds the best score found for the column                   */
+   size_t period = 0,   /* Holds the number of letters in the key                      */
+          column,       /* Holds the letter of the key being climbed                   */
+          index;        /* Holds the character being read                              */
+   int    delta,        /* Holds how far the column has been moved                     */
+          best_delta,   /* Holds the move that gave the best score                     */
+          improved;     /* Holds whether the last pass changed the key                 */
+
+   pthread_once(&set_up_once, set_up);
+   for (period = 0; key[period] != '\0'; period++) {
+      if (test_character(key[period]) != LOWER) {
+         errno = EINVAL;
+         return -1;
+      }
+   }
+   if (period == 0) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   /* Decrypt the letters of the sample with the key as it stands                      */
+   if (sample == 0 || sample > length) {
+      sample = length;
+   }
+   if ((tally.letters = (unsigned char *) malloc(sample)) == NULL) {
+      errno = ENOMEM;
+      return -1;
+   }
+   tally.table = scorer->table;
+   tally.count = 0;
+   for (index = 0; index < length && tally.count < sample; index++) {
+      if (letter_table[(unsigned char) input[index]]) {
+         tally.letters[tally.count] =
+            (unsigned char) (((input[index] | 0x20) - LOWER_INT + ALPHABET -
+                              (key[tally.count % period] - LOWER_INT)) % ALPHABET);
+         tally.count++;
+      }
+   }
+   tally.score = score_column(&tally, 0, 1);
+
+   /* Climb each letter of the key in turn until a whole pass finds nothing better     */
+   do {
+      improved = 0;
+      for (column = 0; column < period; column++) {
+         rest       = tally.score - score_column(&tally, column, period);
+         best       = tally.score;
+         best_delta = 0;
+         for (delta = 1; delta < ALPHABET; delta++) {
+            move_column(&tally, column, period, 1);
+            score = rest + score_column(&tally, column, period);
+            if (score > best + CLIMB_GAIN) {
+               best       = score;
+               best_delta = delta;
+            }
+         }
+
+         /* One more move brings the column back around to where it started            */
+         move_column(&tally, column, period, 1 + best_delta);
+         if (best_delta > 0) {
+            tally.score = best;
+            key[column] = (char) ((key[column] - LOWER_INT + ALPHABET - best_delta) %
+                                  ALPHABET + LOWER_INT);
+            improved    = 1;
+         }
+      }
+   } while (improved);
+
+   free(tally.letters);
+
+   return 0;
+}
+
+/* Deletes a scorer                                                                    */
+void   cipher_scorer_destroy(CIPHER_SCORER *scorer) {
+   if (scorer != NULL) {
+      if (scorer->mapping != NULL) {
+         munmap(scorer->mapping, scorer->size);
+      } else {
+         free((float *) scorer->table);
+      }
+      free(scorer);
+   }
+
+   return;
+}
+
+/* Fills the tables and chooses the kernels                                            */
+static void   set_up() {
+   build_tables();
+   select_kernels();
+
+   return;
+}
+
+/* Tests if a character is uppercase or lowercase                                      */
+static char   test_character(char check) {
+   char test; /* Holds the test's response                                             */
+
+   if (check >= 'a' && check <= 'z') {
+      test = LOWER;
+   } else if (check >= 'A' && check <= 'Z') {
+      test = UPPER;
+   } else {
+      test = NEITHER;
+   }
+
+   return test;
+}
+
+/* Fills the shift and letter tables                                                   */
+static void   build_tables() {
+   int shift,     /* Holds the shift whose table is being filled                       */
+       character; /* Holds the character being placed in the table                     */
+
+   for (shift = 0; shift < ALPHABET; shift++) {
+      for (character = 0; character < CHARACTERS; character++) {
+         if (test_character((char) character) == UPPER) {
+            shift_tables[shift][character] =
+                                 (character - UPPER_INT + shift) % ALPHABET + UPPER_INT;
+         } else if (test_character((char) character) == LOWER) {
+            shift_tables[shift][character] =
+                                 (character - LOWER_INT + shift) % ALPHABET + LOWER_INT;
+         } else {
+            shift_tables[shift][character] = character;
+         }
+      }
+   }
+   for (character = 0; character < CHARACTERS; character++) {
+      letter_table[character] = test_character((char) character) != NEITHER;
+   }
+
+   return;
+}
+
+/* Chooses the fastest kernels this processor can run                                  */
+static void   select_kernels() {
+   shift_kernel      = shift_scalar;
+   key_kernel        = key_scalar;
+   shift_kernel_name = "scalar";
+   key_kernel_name   = "scalar";
+#ifdef X86_KERNELS
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2")) {
+      shift_kernel      = shift_sse2;
+      shift_kernel_name = "sse2";
+   }
+   if (__builtin_cpu_supports("ssse3")) {
+      key_kernel      = key_ssse3;
+      key_kernel_name = "ssse3";
+   }
+   if (__builtin_cpu_supports("avx2")) {
+      shift_kernel      = shift_avx2;
+      key_kernel        = key_avx2;
+      shift_kernel_name = "avx2";
+      key_kernel_name   = "avx2";
+   }
+#endif
+
+   return;
+}
+
+/* Counts the processors the program can run on                                        */
+static int    count_processors() {
+   long processors = sysconf(_SC_NPROCESSORS_ONLN); /* Holds the count from the system */
+
+   if (processors < 1) {
+      processors = 1;
+   } else if (processors > CIPHER_MAX_THREADS) {
+      processors = CIPHER_MAX_THREADS;
+   }
+
+   return (int) processors;
+}
+
+/* Counts the letters in a buffer                                                      */
+static size_t count_letters(const char *characters, size_t length) {
+   unsigned long long word;        /* Holds the characters being counted               */
+   size_t             letters = 0, /* Holds the number of letters found                */
+                      index;       /* Holds the character's place                      */
+
+   /* Adding up the bytes' top bits in the top byte counts a word's letters at once    */
+   for (index = 0; index + WORD_BYTES <= length; index += WORD_BYTES) {
+      memcpy(&word, characters + index, WORD_BYTES);
+      letters += (size_t) ((letter_bits(word) >> 7) * BYTE_ONES >> 56);
+   }
+   for (; index < length; index++) {
+      letters += (unsigned char) ((characters[index] | 0x20) - LOWER_INT) < ALPHABET;
+   }
+
+   return letters;
+}
+
+/* Shifts a buffer by one amount or by a key, splitting it between threads             */
+/* A key needs each share to start at the right letter of the key, so the letters of   */
+/* every share are counted first and the starting positions summed from those counts.  */
+static size_t parallel_cipher(const char *input, char *output, size_t length, int shift,
+                              const unsigned char *shifts, size_t period,
+                              size_t position, int threads) {
+   TASK   tasks[CIPHER_MAX_THREADS]; /* Holds each thread's share of the buffer        */
+   size_t share,                     /* Holds the number of characters in each share   */
+          start = 0;                 /* Holds the place where the next share starts    */
+   int    count = 0,                 /* Holds the number of shares                     */
+          index;                     /* Holds the share being set up                   */
+
+   /* Copy the buffer when the shift changes nothing, as a folded chain may            */
+   if (shifts == NULL && shift == 0) {
+      if (input != output) {
+         memmove(output, input, length);
+      }
+      return position;
+   }
+
+   /* Work on the calling thread alone when the buffer is too small to split           */
+   if ((size_t) threads > length / MIN_SHARE) {
+      threads = (int) (length / MIN_SHARE);
+   }
+   if (threads <= 1) {
+      if (shifts == NULL) {
+         shift_kernel(input, output, length, shift);
+      } else {
+         position = key_kernel(input, output, length, shifts, period, position);
+      }
+      return position;
+   }
+
+   /* Split the buffer into shares that start on cache line boundaries                 */
+   share = ((length + threads - 1) / threads + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+   do {
+      tasks[count].input   = input + start;
+      tasks[count].output  = output + start;
+      tasks[count].length  = length - start < share ? length - start : share;
+      tasks[count].shift   = shift;
+      tasks[count].shifts  = shifts;
+      tasks[count].period  = period;
+      tasks[count].letters = 0;
+      start += tasks[count].length;
+      count++;
+   } while (start < length);
+
+   /* Caesar shares are independent, so shift them straight away                       */
+   if (shifts == NULL) {
+      run_tasks(tasks, sizeof(TASK), count, shift_task);
+      return position;
+   }
+
+   /* Find where in the key each share starts, then shift them all                     */
+   run_tasks(tasks, sizeof(TASK), count, count_task);
+   for (index = 0; index < count; index++) {
+      tasks[index].position = position;
+      position              = (position + tasks[index].letters) % period;
+   }
+   run_tasks(tasks, sizeof(TASK), count, shift_task);
+
+   return position;
+}
+
+/* Runs each task on its own thread, the first on the calling thread; the tasks are    */
+/* of any type, laid out one after another size characters apart                       */
+static void   run_tasks(void *tasks, size_t size, int count, void *(*work)(void *)) {
+   pthread_t workers[CIPHER_MAX_THREADS]; /* Holds the thread running each task        */
+   int       started[CIPHER_MAX_THREADS], /* Holds whether each task has a thread      */
+             index;                       /* Holds the task being started or joined    */
+   char      *first = (char *) tasks;     /* Points to the first task                  */
+
+   /* A task whose thread cannot be started is run on the calling thread instead       */
+   for (index = 1; index < count; index++) {
+      started[index] = pthread_create(&workers[index], NULL, work,
+                                      first + index * size) == 0;
+      if (!started[index]) {
+         work(first + index * size);
+      }
+   }
+   work(first);
+   for (index = 1; index < count; index++) {
+      if (started[index]) {
+         pthread_join(workers[index], NULL);
+      }
+   }
+
+   return;
+}
+
+/* Counts the letters of a task's share                                                */
+static void   *count_task(void *task) {
+   TASK *share = (TASK *) task; /* Points to the task being worked on                  */
+
+   share->letters = count_letters(share->input, share->length);
+
+   return NULL;
+}
+
+/* Shifts a task's share                                                               */
+static void   *shift_task(void *task) {
+   TASK *share = (TASK *) task; /* Points to the task being worked on                  */
+
+   if (share->shifts == NULL) {
+      shift_kernel(share->input, share->output, share->length, share->shift);
+   } else {
+      key_kernel(share->input, share->output, share->length,
+                 share->shifts, share->period, share->position);
+   }
+
+   return NULL;
+}
+
+/* Changes each record of a batch's share with its own cipher                          */
+static void   *batch_task(void *task) {
+   BATCH               *batch = (BATCH *) task; /* Points to the share being worked on */
+   const CIPHER_RECORD *record;                 /* Points to the record being changed  */
+   const CIPHER        *cipher;                 /* Points to the record's cipher       */
+   size_t              index;                   /* Holds the record's place            */
+
+   for (index = batch->first; index < batch->last; index++) {
+      record = &batch->records[index];
+      cipher = batch->ciphers[record->key];
+      if (cipher->shift >= 0) {
+         shift_kernel(batch->input + record->offset, batch->output + record->offset,
+                      record->length, batch->action == CIPHER_ENCRYPT
+                                         ? cipher->shift
+                                         : (ALPHABET - cipher->shift) % ALPHABET);
+      } else {
+         key_kernel(batch->input + record->offset, batch->output + record->offset,
+                    record->length, batch->action == CIPHER_ENCRYPT
+                                       ? cipher->encode_shifts : cipher->decode_shifts,
+                    cipher->period, 0);
+      }
+   }
+
+   return NULL;
+}
+
+/* Scores how far the letters counted are from English once moved back by a rotation   */
+/* A plaintext letter under a rotation was counted as the letter that far past it.     */
+static double chi_squared(const unsigned long long counts[ALPHABET], int rotation) {
+   unsigned long long total = 0; /* Holds the number of letters counted                */
+   double             score = 0, /* Holds the sum of the letters' distances            */
+                      expected,  /* Holds how often a letter should appear in English  */
+                      excess;    /* Holds how much more often it appeared than that    */
+   int                letter;    /* Holds the plaintext letter being compared          */
+
+   for (letter = 0; letter < ALPHABET; letter++) {
+      total += counts[letter];
+   }
+   for (letter = 0; total > 0 && letter < ALPHABET; letter++) {
+      expected  = (double) total * english_frequencies[letter];
+      excess    = (double) counts[(letter + rotation) % ALPHABET] - expected;
+      score    += excess * excess / expected;
+   }
+
+   return score;
+}
+
+/* Counts the letters of one column of the ciphertext under a key length               */
+static void   count_column(const unsigned char *letters, size_t count, size_t column,
+                           size_t length, unsigned long long counts[CIPHER_ALPHABET]) {
+   size_t index; /* Holds the letter's place                                           */
+
+   for (index = 0; index < ALPHABET; index++) {
+      counts[index] = 0;
+   }
+   for (index = column; index < count; index += length) {
+      counts[letters[index]]++;
+   }
+
+   return;
+}
+
+/* Splits the key lengths or columns of a search between threads and runs them         */
+static void   run_search(const unsigned char *letters, size_t count, size_t last,
+                         double *coincidences, unsigned char *shifts, int threads,
+                         void *(*work)(void *)) {
+   SEARCH searches[CIPHER_MAX_THREADS]; /* Holds each thread's share of the search     */
+   int    index;                        /* Holds the share being set up                */
+
+   /* Lengths run from 1 to the last and columns from 0 to one before it               */
+   if (threads > CIPHER_MAX_THREADS) {
+      threads = CIPHER_MAX_THREADS;
+   }
+   if ((size_t) threads > last) {
+      threads = (int) last;
+   }
+   for (index = 0; index < threads; index++) {
+      searches[index].letters      = letters;
+      searches[index].count        = count;
+      searches[index].first        = (size_t) index + (shifts == NULL);
+      searches[index].step         = (size_t) threads;
+      searches[index].last         = last;
+      searches[index].coincidences = coincidences;
+      searches[index].shifts       = shifts;
+   }
+   run_tasks(searches, sizeof(SEARCH), threads, work);
+
+   return;
+}
+
+/* Finds the index of coincidence of a search's share of the key lengths               */
+/* It is the chance that two letters of the same column match, averaged over the       */
+/* columns, and is highest when every column was shifted by the same letter.           */
+static void   *coincidence_task(void *task) {
+   SEARCH             *search = (SEARCH *) task; /* Points to the search being run     */
+   unsigned long long counts[ALPHABET],          /* Holds the letters of a column      */
+                      pairs,                     /* Holds the matching pairs in it     */
+                      letters;                   /* Holds the number of letters in it  */
+   double             total;                     /* Holds the sum of the indexes       */
+   size_t             length,                    /* Holds the key length being tried   */
+                      column;                    /* Holds the column being counted     */
+   int                letter;                    /* Holds the letter being paired      */
+
+   for (length = search->first; length <= search->last; length += search->step) {
+      total = 0;
+      for (column = 0; column < length; column++) {
+         count_column(search->letters, search->count, column, length, counts);
+         pairs   = 0;
+         letters = 0;
+         for (letter = 0; letter < ALPHABET; letter++) {
+            pairs   += counts[letter] * (counts[letter] - (counts[letter] > 0));
+            letters += counts[letter];
+         }
+         total += (double) pairs / ((double) letters * (double) (letters - 1));
+      }
+      search->coincidences[length] = total / (double) length;
+   }
+
+   return NULL;
+}
+
+/* Finds the shift of each of a search's share of the columns                          */
+static void   *column_task(void *task) {
+   SEARCH             *search = (SEARCH *) task; /* Points to the search being run     */
+   unsigned long long counts[ALPHABET];          /* Holds the letters of the column    */
+   CIPHER_GUESS       guesses[ALPHABET];         /* Holds the column's rotations       */
+   size_t             column;                    /* Holds the column being solved      */
+
+   for (column = search->first; column < search->last; column += search->step) {
+      count_column(search->letters, search->count, column, search->last, counts);
+      cipher_rank_rotations(counts, guesses);
+      search->shifts[column] = (unsigned char) guesses[0].rotation;
+   }
+
+   return NULL;
+}
+
+/* Sorts guesses by score, keeping ties in order of rotation                           */
+static void   sort_guesses(CIPHER_GUESS guesses[CIPHER_ALPHABET]) {
+   CIPHER_GUESS guess; /* Holds the guess being moved into its place                   */
+   int          next,  /* Holds the guess being placed                                 */
+                place; /* Holds where the guess goes in the ranking                    */
+
+   for (next = 1; next < ALPHABET; next++) {
+      guess = guesses[next];
+      for (place = next; place > 0 && guesses[place - 1].score > guess.score; place--) {
+         guesses[place] = guesses[place - 1];
+      }
+      guesses[place] = guess;
+   }
+
+   return;
+}
+
+/* Writes a whole buffer to a file descriptor, however many calls it takes             */
+static int    write_whole(int file, const void *data, size_t length) {
+   const char *characters = (const char *) data; /* Points to what is left to write    */
+   ssize_t    written;                           /* Holds what one call wrote          */
+
+   while (length > 0) {
+      if ((written = write(file, characters, length)) < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return 0;
+      }
+      characters += written;
+      length     -= (size_t) written;
+   }
+
+   return 1;
+}
+
+/* Sums the scores of the quadgrams holding any letter of a column, each once          */
+/* A quadgram holds a letter when it starts up to three letters before it. When the    */
+/* column's letters are closer together than that, a quadgram starting before the last */
+/* letter's was already counted, so each letter only adds the quadgrams after those.   */
+static double score_column(const TALLY *tally, size_t first, size_t step) {
+   const unsigned char *letters = tally->letters; /* Points to the text's letters      */
+   double              score    = 0;              /* Holds the sum of the scores       */
+   size_t              letter,                    /* Holds the column letter's place   */
+                       start,                     /* Holds where a quadgram starts     */
+                       next     = 0;              /* Holds the first quadgram not yet  */
+                                                  /* counted                           */
+
+   for (letter = first; letter < tally->count; letter += step) {
+      start = letter < 3 ? 0 : letter - 3;
+      for (start = start < next ? next : start;
+           start <= letter && start + 4 <= tally->count; start++) {
+         score += tally->table[((letters[start] * ALPHABET + letters[start + 1]) *
+                                ALPHABET + letters[start + 2]) * ALPHABET +
+                               letters[start + 3]];
+      }
+      next = letter + 1;
+   }
+
+   return score;
+}
+
+/* Moves every letter of a column the same amount along the alphabet                   */
+static void   move_column(TALLY *tally, size_t first, size_t step, int delta) {
+   size_t letter; /* Holds the column letter's place                                   */
+
+   for (letter = first; letter < tally->count; letter += step) {
+      tally->letters[letter] = (unsigned char) ((tally->letters[letter] + delta) %
+                                                ALPHABET);
+   }
+
+   return;
+}
+
+/* Shifts every letter of a buffer by one amount, a character at a time                */
+static void   shift_scalar(const char *input, char *output, size_t length, int shift) {
+   const unsigned char *table = shift_tables[shift]; /* Points to the shift's table    */
+   size_t              index = 0,                    /* Holds the character's place    */
+                       end;                          /* Holds the end of a word        */
+
+   /* Runs without letters, such as most UTF-8 text, are copied a word at a time       */
+   while (index < length) {
+      index += skip_plain(input + index, output + index, length - index);
+      for (end = length - index < WORD_BYTES ? length : index + WORD_BYTES; index < end;
+           index++) {
+         output[index] = (char) table[(unsigned char) input[index]];
+      }
+   }
+
+   return;
+}
+
+/* Shifts the letters of a buffer by a key, a character at a time                      */
+static size_t key_scalar(const char *input, char *output, size_t length,
+                         const unsigned char *shifts, size_t period, size_t position) {
+   unsigned char character; /* Holds the character being shifted                       */
+   size_t        index = 0, /* Holds the character's place                             */
+                 end;       /* Holds the end of a word                                 */
+
+   /* The key only moves on letters, so it stays put across a run copied whole         */
+   while (index < length) {
+      index += skip_plain(input + index, output + index, length - index);
+      for (end = length - index < WORD_BYTES ? length : index + WORD_BYTES; index < end;
+           index++) {
+         character      = (unsigned char) input[index];
+         output[index]  = (char) shift_tables[shifts[position]][character];
+         position      += letter_table[character];
+         position       = position == period ? 0 : position;
+      }
+   }
+
+   return position;
+}
+
+/* Gives a word with the top bit set of each of its bytes that is an ASCII letter      */
+/* Each byte is folded to lowercase and tested against 'a' and 'z' with sums that      */
+/* cannot carry into the next byte. A byte with its top bit set, which is every byte   */
+/* of a multibyte UTF-8 character, is never a letter, whatever the locale.             */
+static unsigned long long letter_bits(unsigned long long word) {
+   unsigned long long folded = word | BYTE_ONES * 0x20,  /* Holds the bytes folded     */
+                      low    = folded & BYTE_ONES * 0x7F; /* Holds their lower 7 bits  */
+
+   return (BYTE_ONES * (0x7F + 'z' + 1) - low) & ~folded &
+          (low + BYTE_ONES * (0x7F - ('a' - 1))) & BYTE_ONES * 0x80;
+}
+
+/* Copies the words at the start of a buffer that hold no letters, and gives how many  */
+/* characters were copied                                                              */
+static size_t skip_plain(const char *input, char *output, size_t length) {
+   unsigned long long word;  /* Holds the characters being tested                      */
+   size_t             index; /* Holds the place of the word                            */
+
+   for (index = 0; index + WORD_BYTES <= length; index += WORD_BYTES) {
+      memcpy(&word, input + index, WORD_BYTES);
+      if (letter_bits(word) != 0) {
+         break;
+      }
+      memcpy(output + index, &word, WORD_BYTES);
+   }
+
+   return index;
+}
+
+/* Gives the next number of the generator the kernel check fills its buffers from      */
+static unsigned long long check_random(unsigned long long *seed) {
+   *seed ^= *seed << 13;
+   *seed ^= *seed >> 7;
+   *seed ^= *seed << 17;
+
+   return *seed;
+}
+
+/* Fills a buffer for the kernel check with runs of letters, of ASCII that is not a    */
+/* letter, of bytes with the top bit set and of any byte at all                        */
+static void   fill_check(char *buffer, size_t length, unsigned long long *seed) {
+   unsigned long long number; /* Holds the random number for a character               */
+   size_t             index,  /* Holds the character being filled                      */
+                      end;    /* Holds the end of the run                              */
+   int                kind;   /* Holds what the run is made of                         */
+
+   for (index = 0; index < length; ) {
+      kind = (int) (check_random(seed) % 4);
+      end  = index + 1 + (size_t) (check_random(seed) % 48);
+      for (end = end < length ? end : length; index < end; index++) {
+         number        = check_random(seed) >> 8;
+         buffer[index] = (char) (kind == 0 ? (number & 1 ? 'a' : 'A') + number / 2 %
+                                                                  ALPHABET
+                               : kind == 1 ? ' ' + number % 32
+                               : kind == 2 ? 0x80 + number % 128
+                               : number % CHARACTERS);
+      }
+   }
+
+   return;
+}
+
+#ifdef X86_KERNELS
+/* Shifts every letter of a buffer by one amount, 16 characters at a time              */
+__attribute__((target("sse2")))
+static void   shift_sse2(const char *input, char *output, size_t length, int shift) {
+   const __m128i case_bit   = _mm_set1_epi8(0x20),
+                 bias       = _mm_set1_epi8((char) (0x80 - LOWER_INT)),
+                 last       = _mm_set1_epi8((char) (-128 + ALPHABET)),
+                 wrap_point = _mm_set1_epi8((char) (-128 + ALPHABET - 1 - shift)),
+                 shifts     = _mm_set1_epi8((char) shift),
+                 alphabet   = _mm_set1_epi8(ALPHABET);
+   __m128i       block,     /* Holds the characters being shifted                      */
+                 place,     /* Holds each letter's place in the alphabet, less 128     */
+                 letters,   /* Holds which characters are letters                      */
+                 wraps;     /* Holds which letters pass 'z' once shifted               */
+   size_t        index;     /* Holds the place of the block                            */
+
+   for (index = 0; index + 16 <= length; index += 16) {
+      block   = _mm_loadu_si128((const __m128i *) (input + index));
+      place   = _mm_add_epi8(_mm_or_si128(block, case_bit), bias);
+      letters = _mm_cmplt_epi8(place, last);
+      wraps   = _mm_and_si128(_mm_cmpgt_epi8(place, wrap_point), letters);
+      block   = _mm_add_epi8(block, _mm_and_si128(shifts, letters));
+      block   = _mm_sub_epi8(block, _mm_and_si128(alphabet, wraps));
+      _mm_storeu_si128((__m128i *) (output + index), block);
+   }
+   shift_scalar(input + index, output + index, length - index, shift);
+
+   return;
+}
+
+/* Shifts every letter of a buffer by one amount, 32 characters at a time              */
+__attribute__((target("avx2")))
+static void   shift_avx2(const char *input, char *output, size_t length, int shift) {
+   const __m256i case_bit   = _mm256_set1_epi8(0x20),
+                 bias       = _mm256_set1_epi8((char) (0x80 - LOWER_INT)),
+                 last       = _mm256_set1_epi8((char) (-128 + ALPHABET)),
+                 wrap_point = _mm256_set1_epi8((char) (-128 + ALPHABET - 1 - shift)),
+                 shifts     = _mm256_set1_epi8((char) shift),
+                 alphabet   = _mm256_set1_epi8(ALPHABET);
+   __m256i       block,     /* Holds the characters being shifted                      */
+                 place,     /* Holds each letter's place in the alphabet, less 128     */
+                 letters,   /* Holds which characters are letters                      */
+                 wraps;     /* Holds which letters pass 'z' once shifted               */
+   size_t        index;     /* Holds the place of the block                            */
+
+   for (index = 0; index + 32 <= length; index += 32) {
+      block   = _mm256_loadu_si256((const __m256i *) (input + index));
+      place   = _mm256_add_epi8(_mm256_or_si256(block, case_bit), bias);
+      letters = _mm256_cmpgt_epi8(last, place);
+      wraps   = _mm256_and_si256(_mm256_cmpgt_epi8(place, wrap_point), letters);
+      block   = _mm256_add_epi8(block, _mm256_and_si256(shifts, letters));
+      block   = _mm256_sub_epi8(block, _mm256_and_si256(alphabet, wraps));
+      _mm256_storeu_si256((__m256i *) (output + index), block);
+   }
+
+   /* Clear the upper halves of the registers so the 16-character kernel runs at speed */
+   _mm256_zeroupper();
+   shift_sse2(input + index, output + index, length - index, shift);
+
+   return;
+}
+
+/* Shifts the letters of a buffer by a key, 16 characters at a time                    */
+/* Each letter's place in the key stream is the count of letters before it, so the     */
+/* shifts are shuffled out of the stream by a running sum of the letter mask. A block  */
+/* holds fewer letters than the period, so one subtraction brings the position back.   */
+__attribute__((target("ssse3")))
+static size_t key_ssse3(const char *input, char *output, size_t length,
+                        const unsigned char *shifts, size_t period, size_t position) {
+   const __m128i case_bit  = _mm_set1_epi8(0x20),
+                 bias      = _mm_set1_epi8((char) (0x80 - LOWER_INT)),
+                 last      = _mm_set1_epi8((char) (-128 + ALPHABET)),
+                 last_fit  = _mm_set1_epi8((char) (-128 + ALPHABET - 1)),
+                 one       = _mm_set1_epi8(1),
+                 alphabet  = _mm_set1_epi8(ALPHABET);
+   __m128i       block,    /* Holds the characters being shifted                       */
+                 place,    /* Holds each letter's place in the alphabet, less 128      */
+                 letters,  /* Holds which characters are letters                       */
+                 ranks,    /* Holds how many letters come before each character        */
+                 stream,   /* Holds the shift of each letter of the block              */
+                 wraps;    /* Holds which letters pass 'z' once shifted                */
+   size_t        index;    /* Holds the place of the block                             */
+   int           mask;     /* Holds a bit for each letter of the block                 */
+
+   for (index = 0; index + 16 <= length; index += 16) {
+      block   = _mm_loadu_si128((const __m128i *) (input + index));
+      place   = _mm_add_epi8(_mm_or_si128(block, case_bit), bias);
+      letters = _mm_cmplt_epi8(place, last);
+      if ((mask = _mm_movemask_epi8(letters)) == 0) {
+         _mm_storeu_si128((__m128i *) (output + index), block);
+         continue;
+      }
+
+      /* Count the letters before each character and shuffle out their shifts          */
+      ranks  = _mm_and_si128(letters, one);
+      ranks  = _mm_add_epi8(ranks, _mm_slli_si128(ranks, 1));
+      ranks  = _mm_add_epi8(ranks, _mm_slli_si128(ranks, 2));
+      ranks  = _mm_add_epi8(ranks, _mm_slli_si128(ranks, 4));
+      ranks  = _mm_add_epi8(ranks, _mm_slli_si128(ranks, 8));
+      ranks  = _mm_sub_epi8(ranks, one);
+      stream = _mm_loadu_si128((const __m128i *) (shifts + position));
+      stream = _mm_and_si128(_mm_shuffle_epi8(stream, ranks), letters);
+
+      /* Shift the letters, wrapping the ones that pass 'z'                            */
+      wraps = _mm_and_si128(_mm_cmpgt_epi8(_mm_add_epi8(place, stream), last_fit),
+                            letters);
+      block = _mm_add_epi8(block, stream);
+      block = _mm_sub_epi8(block, _mm_and_si128(alphabet, wraps));
+      _mm_storeu_si128((__m128i *) (output + index), block);
+
+      position += (size_t) __builtin_popcount((unsigned int) mask);
+      if (position >= period) {
+         position -= period;
+      }
+   }
+
+   return key_scalar(input + index, output + index, length - index,
+                     shifts, period, position);
+}
+
+/* Shifts the letters of a buffer by a key, 32 characters at a time                    */
+/* The shuffle stays within each 16-character half, so the upper half reads the key    */
+/* stream from after the letters of the lower half.                                    */
+__attribute__((target("avx2,popcnt")))
+static size_t key_avx2(const char *input, char *output, size_t length,
+                       const unsigned char *shifts, size_t period, size_t position) {
+   const __m256i case_bit  = _mm256_set1_epi8(0x20),
+                 bias      = _mm256_set1_epi8((char) (0x80 - LOWER_INT)),
+                 last      = _mm256_set1_epi8((char) (-128 + ALPHABET)),
+                 last_fit  = _mm256_set1_epi8((char) (-128 + ALPHABET - 1)),
+                 one       = _mm256_set1_epi8(1),
+                 alphabet  = _mm256_set1_epi8(ALPHABET);
+   __m256i       block,    /* Holds the characters being shifted                       */
+                 place,    /* Holds each letter's place in the alphabet, less 128      */
+                 letters,  /* Holds which characters are letters                       */
+                 ranks,    /* Holds how many letters come before each character        */
+                 stream,   /* Holds the shift of each letter of the block              */
+                 wraps;    /* Holds which letters pass 'z' once shifted                */
+   size_t        index,    /* Holds the place of the block                             */
+                 lower;    /* Holds the number of letters in the lower half            */
+   unsigned int  mask;     /* Holds a bit for each letter of the block                 */
+
+   for (index = 0; index + 32 <= length; index += 32) {
+      block   = _mm256_loadu_si256((const __m256i *) (input + index));
+      place   = _mm256_add_epi8(_mm256_or_si256(block, case_bit), bias);
+      letters = _mm256_cmpgt_epi8(last, place);
+      if ((mask = (unsigned int) _mm256_movemask_epi8(letters)) == 0) {
+         _mm256_storeu_si256((__m256i *) (output + index), block);
+         continue;
+      }
+
+      /* Count the letters before each character and shuffle out their shifts          */
+      lower  = (size_t) __builtin_popcount(mask & 0xFFFF);
+      ranks  = _mm256_and_si256(letters, one);
+      ranks  = _mm256_add_epi8(ranks, _mm256_slli_si256(ranks, 1));
+      ranks  = _mm256_add_epi8(ranks, _mm256_slli_si256(ranks, 2));
+      ranks  = _mm256_add_epi8(ranks, _mm256_slli_si256(ranks, 4));
+      ranks  = _mm256_add_epi8(ranks, _mm256_slli_si256(ranks, 8));
+      ranks  = _mm256_sub_epi8(ranks, one);
+      stream = _mm256_inserti128_si256(
+                  _mm256_castsi128_si256(
+                     _mm_loadu_si128((const __m128i *) (shifts + position))),
+                  _mm_loadu_si128((const __m128i *) (shifts + position + lower)), 1);
+      stream = _mm256_and_si256(_mm256_shuffle_epi8(stream, ranks), letters);
+
+      /* Shift the letters, wrapping the ones that pass 'z'                            */
+      wraps = _mm256_and_si256(
+                 _mm256_cmpgt_epi8(_mm256_add_epi8(place, stream), last_fit), letters);
+      block = _mm256_add_epi8(block, stream);
+      block = _mm256_sub_epi8(block, _mm256_and_si256(alphabet, wraps));
+      _mm256_storeu_si256((__m256i *) (output + index), block);
+
+      position += (size_t) __builtin_popcount(mask);
+      if (position >= period) {
+         position -= period;
+      }
+   }
+
+   /* Clear the upper halves of the registers so the 16-character kernel runs at speed */
+   _mm256_zeroupper();
+   return key_ssse3(input + index, output + index, length - index,
+                    shifts, period, position);
+}
+#endif